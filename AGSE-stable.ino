@@ -5,6 +5,12 @@
 #include "Output.h"
 #include "Input.h"
 #include "Linear.h"
+#include "Sequence.h"
+#include "HostLink.h"
+#include "EStop.h"
+#include "Profiler.h"
+#include "Scheduler.h"
+#include "Memory.h"
 #include <LiquidCrystal.h>
 // # define DEBUG_FLAG
 
@@ -12,19 +18,70 @@
  * STATE CONTROL BOOLEANS
  ******************************************************************************/
 volatile bool pauseFlag = false; // ALL low-level actions must check for the pause flag at reasonable intervals
-volatile bool goFlag = false;
-volatile bool homeFlag = false;
-bool homeStartupFlag = false;
+                                 // (set by the pause button's ISR; GO and HOME presses are queued in Input)
 
 /*******************************************************************************
  * OPERATION CONSTANTS
  ******************************************************************************/
- const int GO_PIN = 18;
- const int PAUSE_PIN = 19;
- const int HOME_PIN = 2;
- float SCARA_DIST[] = {5, -23, -4.5, 19.5, -180, -8.6, 8.6, 90}; // SCARA Motions
- bool SCARA_MOTOR[] = {1, 0, 1, 1, 0, 1, 1, 0}; // Scara motors: 0 for rotational, 1 for linear
- int SCARA_COUNT = 8; // Number of automated motions
+ // LCD messages shown by the programs below, by number
+ enum Message {LOADING_PAYLOAD, SECURING_PAYLOAD, ERECTING_RAIL, IGNITION_INSERT,
+               HOMING_SCARA, HOMING_DOOR, HOMING_IGNITOR, HOMING_ERECTOR};
+ const char LOADING_PAYLOAD_TEXT[] PROGMEM = "LOADING PAYLOAD";
+ const char SECURING_PAYLOAD_TEXT[] PROGMEM = "SECURING PAYLOAD";
+ const char ERECTING_RAIL_TEXT[] PROGMEM = "ERECTING RAIL";
+ const char IGNITION_INSERT_TEXT[] PROGMEM = "IGNITION INSERT";
+ const char HOMING_SCARA_TEXT[] PROGMEM = "HOMING SCARA";
+ const char HOMING_DOOR_TEXT[] PROGMEM = "HOMING DOOR";
+ const char HOMING_IGNITOR_TEXT[] PROGMEM = "HOMING IGNITOR";
+ const char HOMING_ERECTOR_TEXT[] PROGMEM = "HOMING ERECTOR";
+ const char * const MESSAGES[] PROGMEM = {LOADING_PAYLOAD_TEXT, SECURING_PAYLOAD_TEXT, ERECTING_RAIL_TEXT,
+     IGNITION_INSERT_TEXT, HOMING_SCARA_TEXT, HOMING_DOOR_TEXT, HOMING_IGNITOR_TEXT, HOMING_ERECTOR_TEXT};
+
+ // Payload load sequence (see Sequence.h). A pause picks up again from the last checkpoint.
+ const uint8_t LOAD_PROGRAM[] PROGMEM = {
+   // (1) Go home first, unless the arm is there already
+   SEQ_HOME,
+   // (2) SCARA motions (deg, cm), one motor at a time: the arm lifts clear before every swing. No
+   // motion blends into the next (SEQ_BLEND) until the clearance has been measured on the rig.
+   SEQ_TOP(LOADING_PAYLOAD),
+   SEQ_LIN(5),
+   SEQ_ROT(-23),
+   SEQ_LIN(-4.5),
+   SEQ_LIN(19.5),
+   SEQ_ROT(-180),
+   SEQ_LIN(-8.6),
+   SEQ_LIN(8.6),
+   SEQ_ROT(90),
+   // (3) Linear actuators. The door cylinder pulls back while the rail goes up; the interlocks in
+   // Linear keep the rail from moving until the door is shut. The door's second motion is only
+   // finished at the very end, so nothing after it is a checkpoint.
+   SEQ_CHECKPOINT,
+   SEQ_TOP(SECURING_PAYLOAD),
+   SEQ_RUN(Linear::DOOR, Linear::EXTEND),
+   SEQ_CHECKPOINT,
+   SEQ_START(Linear::DOOR, Linear::RETRACT),
+   SEQ_TOP(ERECTING_RAIL),
+   SEQ_RUN(Linear::ERECTOR, Linear::RETRACT),
+   SEQ_TOP(IGNITION_INSERT),
+   SEQ_RUN(Linear::IGNITOR, Linear::EXTEND),
+   SEQ_WAIT(Linear::DOOR),
+   SEQ_END
+ };
+
+ // Return to the start. The ignitor pulls out of the rocket while the arm clears the area.
+ const uint8_t HOME_PROGRAM[] PROGMEM = {
+   SEQ_START(Linear::IGNITOR, Linear::RETRACT),
+   SEQ_TOP(HOMING_SCARA),
+   SEQ_HOME,
+   SEQ_TOP(HOMING_DOOR),
+   SEQ_RUN(Linear::DOOR, Linear::RETRACT),
+   SEQ_TOP(HOMING_IGNITOR),
+   SEQ_WAIT(Linear::IGNITOR),
+   SEQ_CHECKPOINT,
+   SEQ_TOP(HOMING_ERECTOR),
+   SEQ_RUN(Linear::ERECTOR, Linear::EXTEND),
+   SEQ_END
+ };
  
 /*******************************************************************************
  * INSTANCE OBJECTS
@@ -32,36 +89,52 @@ bool homeStartupFlag = false;
 Scara scara(&pauseFlag);       // Initialize the motor controller
 Output out;                    // Initialize the output controller
 Linear lin(&pauseFlag);        // Linear motor controller
-Input in;                      // Input button controller
+Input in(&pauseFlag);          // Input button controller
+Profiler loadProfile(EEPROM_LOAD_PROFILE, MESSAGES); // Phase times of LOAD_PROGRAM runs
+Profiler homeProfile(EEPROM_HOME_PROFILE, MESSAGES); // Phase times of HOME_PROGRAM runs
+Sequence loadSequence(&scara, &lin, &out, MESSAGES, &loadProfile, &pauseFlag); // Runs LOAD_PROGRAM
+Sequence homeSequence(&scara, &lin, &out, MESSAGES, &homeProfile, &pauseFlag); // Runs HOME_PROGRAM
+HostLink host(&scara, &pauseFlag); // Motions streamed over the serial port
+EStop estop(&scara, &lin);     // Stops everything within a deadline when PAUSE is pressed
+Scheduler scheduler;           // Runs the periodic jobs below from the 1 ms tick
+Memory memory;                 // SRAM use, for the serial log
 
 /*******************************************************************************
  * SETUP
  ******************************************************************************/
 void setup(){
-  #ifdef DEBUG_FLAG
-  Serial.begin(9600);
-  #endif
-  // initialize timer1 - see https://arduino-info.wikispaces.com/Timers-Arduino
-  timerInit(); // Initialize timer interrupt
+  host.begin(); // Serial port, for streamed motions and debug output
+  // Opening the serial port resets the board, so this is how to get the run history off it
+  Serial.println(F("Load program profile")); loadProfile.report();
+  Serial.println(F("Home program profile")); homeProfile.report();
+  memoryReport();
+
+  // Periodic jobs. The interrupt ones have deadlines; the rest run whenever the foreground waits.
+  scheduler.add(linearTask, 1, Scheduler::INTERRUPT, F("cylinders"));
+  scheduler.add(estopTask, 1, Scheduler::INTERRUPT, F("pause stop"));
+  scheduler.add(patternTask, 1, Scheduler::INTERRUPT, F("lights/horn"));
+  scheduler.add(lcdTask, 1, Scheduler::BACKGROUND, F("lcd"));
+  scheduler.add(hostTask, 1, Scheduler::BACKGROUND, F("host link"));
+  scheduler.add(powerTask, 10, Scheduler::BACKGROUND, F("stepper power"));
+  scheduler.begin(); // Start the 1 ms tick
   
   // Interrupt initialization - Mega, Mega2560, MegaADK has  2, 3, 18, 19, 20, 21 available for interrupts
   // 18 is "GO" and 19 is "pause" and 2 is "home"
-  pinMode(HOME_PIN, INPUT_PULLUP);
-  pinMode(GO_PIN, INPUT_PULLUP);
-  pinMode(PAUSE_PIN, INPUT_PULLUP);
-  attachInterrupt(digitalPinToInterrupt(HOME_PIN), setHome, FALLING);
-  attachInterrupt(digitalPinToInterrupt(GO_PIN), setGo, FALLING);
-  attachInterrupt(digitalPinToInterrupt(PAUSE_PIN), setPause, FALLING);
+  in.attachButtons(homeChange, goChange, pauseChange);
+  // 3, 20 and 21 are cylinder microswitches
+  lin.attachSwitches(linearSwitch);
 
   
   // Setup SCARA arm for automated run - payload load sequence
-  scara.setStates(SCARA_COUNT, SCARA_DIST, SCARA_MOTOR); // enable motors
-  scara.enable();
+  loadSequence.load(LOAD_PROGRAM);
+  homeSequence.load(HOME_PROGRAM);
+  scara.enable(); // enable motors (finished in the background while the self test runs)
 
-  systemChecks(); // Perform important system checks
-  out.printTop("SYSTEMS NOMINAL");
-  out.printBottom("WAITING FOR GO");
+  if (selfTest()) { // Perform important system checks
+    out.printTop(F("SYSTEMS NOMINAL"));
+  }
   pause(); // Ensure all flags reset before continuing
+  out.printBottom(F("WAITING FOR GO")); // After pause(), which says "PAUSED"; the LCD only shows the last word
 
 }
 
@@ -73,21 +146,95 @@ void loop(){
   Serial.println(scara.homed());
   delay(1000);
   #endif
-  // This statement executes if the green button is pressed AND the home procedure
-  // has been completed
-  if (goFlag) {
-    pauseFlag = false;
-    execute();
-    pause();
+  // Act on the buttons in the order they were pressed
+  Input::Event press;
+  if (in.next(press)) {
+    // This statement executes if the green button is pressed.
+    if (press.button == Input::GO) {
+      logPress(press, F("Go"));
+      execute(); // A pause pressed after GO but before now stops it straight away
+      pause();
+      logRun();
+    }
+
+    // This statement executes if the blue button is pressed.
+    else if (press.button == Input::HOME) {
+      logPress(press, F("Home"));
+      // Can add test functions here if desired and comment out "goHome"
+      goHome();
+      pause();
+      logRun();
+    }
+
+    // Nothing is running, so a pause only needs clearing
+    else {
+      logPress(press, F("Pause"));
+      logStop();
+      pauseFlag = false;
+    }
   }
 
-  // This statement executes if the blue button is pressed.
-  if (homeFlag) {
-    pauseFlag = false;
-    // Can add test functions here if desired and comment out "goHome"
-    goHome();
+  // This statement executes if a host starts sending motions over the serial port.
+  else if (host.waiting()) {
+    stream();
     pause();
+    logRun();
   }
+
+  scheduler.run(); // Sleeps until the next interrupt if there is nothing to do
+}
+
+void logPress(const Input::Event &press, const __FlashStringHelper *name) {
+  // Time from the button edge to acting on it, for the serial log
+  unsigned long latency = in.handled(press);
+  Serial.print(name); Serial.print(F(" after ")); Serial.print(latency);
+  Serial.print(F(" us (worst ")); Serial.print(in.worstLatency()); Serial.print(F(" us"));
+  if (in.lost() > 0) {Serial.print(F(", ")); Serial.print(in.lost()); Serial.print(F(" presses lost"));}
+  Serial.println(')');
+}
+
+void logRun() {
+  // How the scheduler and the stack coped with the run, for the serial log
+  scheduler.report();
+  memory.report();
+}
+
+void memoryReport() {
+  // What each object costs in SRAM, and how much is left
+  Serial.println(F("Objects (bytes)"));
+  memory.object(F("scara"), sizeof(scara));
+  memory.object(F("out"), sizeof(out));
+  memory.object(F("lin"), sizeof(lin));
+  memory.object(F("in"), sizeof(in));
+  memory.object(F("loadProfile"), sizeof(loadProfile));
+  memory.object(F("homeProfile"), sizeof(homeProfile));
+  memory.object(F("loadSequence"), sizeof(loadSequence));
+  memory.object(F("homeSequence"), sizeof(homeSequence));
+  memory.object(F("host"), sizeof(host));
+  memory.object(F("estop"), sizeof(estop));
+  memory.object(F("scheduler"), sizeof(scheduler));
+  memory.report();
+}
+
+void logStop() {
+  // Time from the pause edge to everything standing still, for the serial log
+  while (estop.stopping()) { // The tick sees the arm come to rest within a millisecond
+    scheduler.run();
+  }
+  if (!estop.done()) {return;} // Not stopped by the pause button
+  Serial.print(F("Pause Interrupt, stopped after ")); Serial.print(estop.latency());
+  Serial.print(F(" us (worst ")); Serial.print(estop.worstLatency()); Serial.print(F(" us, limit "));
+  Serial.print(estop.deadline()); Serial.print(F(" ms"));
+  if (estop.powerCut()) {Serial.print(F(", STEPPER POWER CUT"));}
+  Serial.println(')');
+  pauseFlag = false; // Before the stop is rearmed, so a press from now on is a new one and stays set
+  estop.clear();
+}
+
+// The core calls this while it waits (in delay()), and so do the motion and cylinder waits, so the
+// background tasks (LCD, host commands, stepper power) keep running while the arm moves
+void yield() {
+  scheduler.run();
 }                                                                                                                                                                                                                                                                                                                                                                 
 
 /*******************************************************************************
@@ -98,46 +245,19 @@ void execute(){
   // Perform actions necessary to win the $25,000 prize.
   
   out.setLight(2); // "setLight(2)" means blink yellow light
-  out.printBottom("RUNNING");
-  
-  // (1) Go to a home position. Use boolean "homePositionFlag" to determine 
-  // whether this step is finished or not.
-  if (!homeStartupFlag) { // If we didn't run this already
-    scara.linMotion(5);  // Traverse upwards 15 cm
-    scara.rotMotion(270); // Rotate all the way outboard
-    scara.linMotion(-30); // Bottom out the arm
-    // Check if the system was paused
-    if (pauseFlag) {return;} // Return if so
-    homeStartupFlag = true;
-  }
-  
-  // (2) Perform payload load sequence using the internal system states.
-  out.printTop("LOADING PAYLOAD");
-  int errState = scara.runAll();
-  
+  out.printBottom(F("RUNNING"));
+
+  // Run LOAD_PROGRAM, or whatever is left of it after a pause
+  int errState = loadSequence.run();
+
   if (errState == -1) { // Go to "pause" state
     return;
   }
 
-  if (errState > 0) { // Microswitch hit
+  if (errState > 0) { // Microswitch hit, home switch missing, bad program or cylinder motion refused
     error(errState); // Go to error function (holds forever)
   }
-  
-  // (3) Perform linear actuator sequence. If "pause" gets hit for any of these, 
-  // we'll get a "pause cascade" that will
-  // end up running to the the next pause check. We use these pause checks just to 
-  // keep the LCD messages lined up correctly.
-  out.printTop("SECURING PAYLOAD");
-  lin.doorExtend();
-  lin.doorRetract();
-  if (pauseFlag) {return;}
-  out.printTop("ERECTING RAIL");
-  lin.erectRetract();
-  if (pauseFlag) {return;}
-  out.printTop("IGNITION INSERT");
-  lin.igniteExtend();
-  
-  if (pauseFlag) {return;}
+
   complete(); // Go to "complete" state
 }
 
@@ -148,42 +268,89 @@ void goHome(){
   // Flash red light
   out.setLight(1); // setLight(1) means blink red light
   
-  out.printBottom("RUNNING");
-
-  // (1) Clear SCARA arm from the area
-  out.printTop("HOMING SCARA");
-  if (!scara.homed()) { // If arm not at "home" location
-    scara.linMotion(15); // Move up
-    scara.rotMotion(360); // Move out
-    scara.linMotion(-30); // Bottom out
-  }
-  
-  // (2) Return linear actuators to home positions
-  out.printTop("HOMING DOOR");
-  lin.doorRetract(); if (pauseFlag) {return;} // Return from pause at each step
-  out.printTop("HOMING IGNITOR");
-  lin.igniteRetract(); if (pauseFlag) {return;} 
-  out.printTop("HOMING ERECTOR");
-  lin.erectExtend(); if (pauseFlag) {return;}
-
-  // (3) Reset the SCARA arm for another run if desired
-  scara.setStates(SCARA_COUNT, SCARA_DIST, SCARA_MOTOR); // enable motors
+  out.printBottom(F("RUNNING"));
+
+  // Run HOME_PROGRAM, or whatever is left of it after a pause
+  int homeState = homeSequence.run();
+  if (homeState == -1) {return;}
+  if (homeState > 0) {error(homeState);}
+  homeProfile.save();
+  Serial.println(F("Home program profile")); homeProfile.report();
+
+  // Reset both programs for another run if desired
+  homeSequence.load(HOME_PROGRAM);
+  loadSequence.load(LOAD_PROGRAM);
 }
 
-void systemChecks() {
-  int delayTime = 1000;
-  // Check reactor
-  out.greenOff(); out.printTop("REACTOR..."); out.redOn(); delay(delayTime);
-  out.redOff(); out.printBottom("ONLINE"); out.greenOn(); delay(delayTime);
+void stream() {
+  // Run motions streamed from a host computer (see HostLink.h)
+  out.setLight(2); // "setLight(2)" means blink yellow light
+  out.printTop(F("STREAMING"));
+  out.printBottom(F("RUNNING"));
+
+  int errState = host.run();
 
-  // Check sensors
-  out.greenOff(); out.printTop("SENSORS..."); out.redOn(); delay(delayTime);
-  out.redOff(); out.printBottom("ONLINE"); out.greenOn(); delay(delayTime);
+  // The arm is somewhere else now, so the load sequence has to start again from home
+  loadSequence.load(LOAD_PROGRAM);
+  if (errState == HostLink::TIMED_OUT) { // The host has gone; the arm is at rest and its position known
+    Serial.println(F("Host timed out"));
+  }
+  else if (errState > 0) { // Microswitch hit
+    error(errState); // Go to error function (holds forever)
+  }
+}
 
-  // Check sensors
-  out.greenOff(); out.printTop("IGNITION..."); out.redOn(); delay(delayTime);
-  out.redOff(); out.printBottom("ONLINE"); out.greenOn(); delay(delayTime);
-  out.greenOff();
+bool selfTest() {
+  // Boot check of every switch and output that can be read back. It runs while scara.enable() lets the
+  // stepper supply settle, so it adds no time of its own. The tower lamps and the LCD cannot be read
+  // back, so the lamps are lit meanwhile for the operator to see.
+  unsigned long started = millis();
+  out.printTop(F("SELF TEST"));
+  out.redOn(); out.yellowOn(); out.greenOn();
+  int faults = 0;
+
+  uint8_t held = in.selfTest();
+  if (held & (1 << Input::GO)) {fault(faults, F("GO BUTTON"));}
+  if (held & (1 << Input::PAUSE)) {fault(faults, F("PAUSE BTN"));}
+  if (held & (1 << Input::HOME)) {fault(faults, F("HOME BTN"));}
+
+  uint8_t cylinders = lin.selfTest();
+  if (cylinders & (1 << Linear::DOOR)) {fault(faults, F("DOOR"));}
+  if (cylinders & (1 << Linear::IGNITOR)) {fault(faults, F("IGNITOR"));}
+  if (cylinders & (1 << Linear::ERECTOR)) {fault(faults, F("ERECTOR"));}
+
+  uint8_t outputs = out.selfTest();
+  if (outputs & Output::RED) {fault(faults, F("RED LIGHT"));}
+  if (outputs & Output::YELLOW) {fault(faults, F("YLW LIGHT"));}
+  if (outputs & Output::GREEN) {fault(faults, F("GRN LIGHT"));}
+  if (outputs & Output::HORN) {fault(faults, F("HORN"));}
+  if (outputs & Output::LED) {fault(faults, F("LED"));}
+  if (outputs & Output::LCD) {fault(faults, F("LCD"));}
+
+  // The drivers come on a second after the relay closes
+  while (!scara.powered() && (millis() - started < 2000)) {scheduler.run();}
+  out.redOff(); out.yellowOff(); out.greenOff();
+  uint8_t arm = scara.selfTest();
+  if (arm & Scara::ROT_SWITCHES) {fault(faults, F("ROT SWITCH"));}
+  if (arm & Scara::LIN_SWITCHES) {fault(faults, F("LIN SWITCH"));}
+  if (arm & Scara::MOTOR_POWER) {fault(faults, F("STEP POWER"));}
+
+  Serial.print(F("Self test: ")); Serial.print(faults); Serial.print(F(" faults in "));
+  Serial.print(millis() - started); Serial.println(F(" ms"));
+  if (faults > 0) {out.redOn();} // Stays on with the pause light
+  return faults == 0;
+}
+
+void fault(int &faults, const __FlashStringHelper *component) {
+  // One failed check: every one goes to the serial log, the first one to the LCD
+  Serial.print(F("Self test FAULT: ")); Serial.println(component);
+  if (faults == 0) {
+    char text[17] = "FAULT ";
+    strncpy_P(text + 6, (const char *)component, sizeof(text) - 7);
+    text[sizeof(text) - 1] = 0;
+    out.printTop(text);
+  }
+  faults++;
 }
 
  /*******************************************************************************
@@ -195,12 +362,15 @@ void systemChecks() {
   out.setLight(0); // setLight(0) means flash no light
   out.yellowOn();
 
-  // Reset all state flow flags
+  // Drop the presses the run ignored, up to the pause that stopped it (all of them if it was not paused)
+  Input::Event press;
+  while (in.next(press)) {
+    if (press.button == Input::PAUSE) {break;} // Its ISR has stopped the motion already
+  }
+  logStop();
   pauseFlag = false;
-  goFlag = false;
-  homeFlag = false;
 
-  out.printBottom("PAUSED");
+  out.printBottom(F("PAUSED"));
  }
  
 
@@ -211,28 +381,70 @@ void error(int errorCode){
   // Wait for "home" command
   out.setLight(0);
   out.redOn();
-  out.printBottom("ERROR");
+  out.printBottom(F("ERROR"));
+  logStop(); // In case the pause had to cut the stepper power
+  logRun();
   
-  while (true) {}
+  while (true) {scheduler.run();}
   
 }
 
 void complete() {
   // Solid green light
   // Sound horn
+  // Show the cycle time
   // Wait for "home" command
-  homeFlag = false;
   out.setLight(0);
   out.greenOn();
-  out.printTop("PROCESS COMPLETE");
-  out.printBottom("WAITING FOR HOME");
-  while (!homeFlag) {
-    continue;
+  out.hornChirp();
+  out.printTop(F("PROCESS COMPLETE"));
+  out.printBottom(F("WAITING FOR HOME"));
+  while (!out.drawn()) {scheduler.run();} // Saving holds up the background tasks, so finish the LCD first
+  loadProfile.save();
+  Serial.println(F("Load program profile")); loadProfile.report();
+  unsigned long shownAt = millis();
+  int line = 0;
+  Input::Event press;
+  while (!in.next(press) || (press.button != Input::HOME)) { // Anything pressed before it is dropped
+    if (millis() - shownAt >= 2000) { // The prompt takes turns with this run's time and the mean of the last runs
+      shownAt += 2000;
+      line = (line + 1) % 3;
+      if (line == 0) {out.printBottom(F("WAITING FOR HOME"));}
+      else if (line == 1) {printSeconds(F("RUN "), loadProfile.total());}
+      else {printSeconds(F("MEAN "), loadProfile.mean());}
+    }
+    scheduler.run();
   }
+  logPress(press, F("Home"));
 
   out.greenOff();
 }
 
+void printSeconds(const __FlashStringHelper *label, unsigned long us) {
+  // A run time on the bottom line, e.g. "RUN 114.07 s" (pauses are left out). Formatted by hand, so
+  // neither the label nor a format string has to be copied into SRAM.
+  char text[17];                    // One row of the LCD and the terminator
+  uint8_t n = 0;
+  const char *p = (const char *)label;
+  char c;
+  while ((n < 16) && ((c = pgm_read_byte(p++)) != 0)) {text[n++] = c;}
+
+  char digits[10];                  // Whole seconds, least significant first
+  uint8_t d = 0;
+  unsigned long seconds = us/1000000;
+  do {
+    digits[d++] = '0' + seconds % 10;
+    seconds /= 10;
+  } while (seconds > 0);
+  while ((d > 0) && (n < 16)) {text[n++] = digits[--d];}
+
+  uint8_t hundredths = (us/10000) % 100;
+  const char fraction[] = {'.', (char)('0' + hundredths/10), (char)('0' + hundredths % 10), ' ', 's'};
+  for (uint8_t i = 0; (i < sizeof(fraction)) && (n < 16); i++) {text[n++] = fraction[i];}
+  text[n] = 0;
+  out.printBottom(text);
+}
+
 /*******************************************************************************
  * SYSTEM TEST FUNCTIONS
  ******************************************************************************/
@@ -240,14 +452,15 @@ void complete() {
 void scaraTest() {
   // Fully test the SCARA arm. Hand on the E-stop, please.
   // Move using the manual arm controls.
-  scara.linMotion(30); // Full up
-  scara.linMotion(-270); // Full inboard
-  scara.linMotion(180); // Most of way inb
-  scara.linMotion(90); // All way inboard
-  scara.linMotion(-30); // Full down
+  scara.linMotion(CENTI(30)); // Full up
+  scara.linMotion(CENTI(-270)); // Full inboard
+  scara.linMotion(CENTI(180)); // Most of way inb
+  scara.linMotion(CENTI(90)); // All way inboard
+  scara.linMotion(CENTI(-30)); // Full down
   
-  // Move using the automated SCARA system
-  int errState = scara.runAll();
+  // Move using the automated load sequence (the cylinders run too)
+  loadSequence.load(LOAD_PROGRAM);
+  int errState = loadSequence.run();
   if (errState == -1) { // Go to "pause" state
     pause();
     return;
@@ -263,20 +476,20 @@ void outputTest() {
   //Fully test the stack tower.
   // Test LCD
   
-  out.printMessage("printMessage Top", "printMessage Bot"); delay(1000);
-  out.printTop("printTop"); delay(1000);
-  out.printBottom("printBottom"); delay(1000);
+  out.printMessage(F("printMessage Top"), F("printMessage Bot")); delay(1000);
+  out.printTop(F("printTop")); delay(1000);
+  out.printBottom(F("printBottom")); delay(1000);
 
   // Test lights
   out.yellowOn(); delay(1000);
   out.redOn(); delay(1000);
   out.greenOn(); delay(1000);
 
-  out.printTop("All lights off");
+  out.printTop(F("All lights off"));
   out.ledOff(); out.yellowOff(); out.redOff(); out.greenOff();
   delay(1000);
   
-  out.printTop("TEST COMPLETE");
+  out.printTop(F("TEST COMPLETE"));
 }
 
 void linearTest() {
@@ -287,11 +500,11 @@ void linearTest() {
   //lin.doorExtend(); // 7 seconds
   //lin.doorRetract();  // 10 seconds. Unless meet microswitch
   lin.erectRetract();  // 10 seconds. Unless meet microswitch
-  out.printTop("EXTENDED");
+  out.printTop(F("EXTENDED"));
   //lin.igniteExtend(); // 10 seconds. Unless meet microswitch
   //lin.igniteRetract(); // 10 seconds. Unless meet microswitch
   lin.erectExtend();  // 10 seconds. Unless meet microswitch
-  out.printTop("RETRACTED");
+  out.printTop(F("RETRACTED"));
 }
 
 
@@ -299,39 +512,60 @@ void linearTest() {
  * INTERRUPT HANDLING
  ******************************************************************************/
  
-// TIMER INITIALIZATION
-void timerInit() {
-  // This is magic. Don't touch it.
-    noInterrupts();           // disable all interrupts
-    TCCR1A = 0;               // set entire TCCR1A register to 0
-    TCCR1B = 0;               // same for TCCR1B 
-    TCNT1  = 0;               // Initialize counter to 0
-  
-    OCR1A = 62500;            // compare match register 16MHz/256/1Hz
-    TCCR1B |= (1 << WGM12);   // CTC mode
-    TCCR1B |= (1 << CS12);    // 256 prescaler 
-    TIMSK1 |= (1 << OCIE1A);  // enable timer compare interrupt
-    interrupts();             // enable all interrupts
+// SCHEDULER TASKS (see setup() for their periods)
+void linearTask() { // Cylinder timing and interlocks
+  lin.tick();
+}
+
+void estopTask() { // Pause stop deadline
+  estop.tick();
+}
+
+void patternTask() { // Light tower, horn and LED patterns
+  out.tick();
+}
+
+void lcdTask() { // Next byte of the LCD frame buffer
+  out.flush();
+}
+
+void hostTask() { // Commands from the host
+  host.poll();
+}
+
+void powerTask() { // Second half of Scara::enable()/disable()
+  scara.power();
 }
 
 // INTERRUPT SERVICE ROUTINES 
-void setPause() { // set a global "pause" flag to "True"
-  Serial.println("Pause Interrupt");
-  pauseFlag = true;
+void pauseChange() { // Pause button edge; sets the global "pause" flag on a press
+  if (in.pauseISR()) {estop.trigger();} // A press: cylinders off now, steppers braking against the deadline
+}
+
+void goChange() { // Go button edge; queues a press
+  in.goISR();
+}
+
+void homeChange() { // Home button edge; queues a press
+  in.homeISR();
+}
+
+void linearSwitch() { // A cylinder microswitch closed
+  lin.switchISR();
 }
 
-void setGo() { // Set global "go" flag to "true"
-  goFlag = true;
+// Scheduler tick, every millisecond (Timer2, set up by scheduler.begin())
+ISR(TIMER2_COMPA_vect) {
+ scheduler.tick();
 }
 
-void setHome() { // Set global "go" flag to "true"
-  homeFlag = true;
+// Stepper pulse generation - each motor runs from its own timer (see Axis.cpp)
+ISR(TIMER3_COMPA_vect) {       // rotational motor step
+ scara.rotISR();
 }
 
-//This odd function blinks our light
-ISR(TIMER1_COMPA_vect) {       // timer compare interrupt service routine
- out.ledToggle();
- out.toggle();
+ISR(TIMER4_COMPA_vect) {       // linear motor step
+ scara.linISR();
 }
 
 
@@ -0,0 +1,395 @@
+// Class to generate step pulses for one stepper motor from a hardware timer interrupt. The foreground
+// queues motion profiles with push(); the timer compare-match ISR emits one pulse per interrupt and
+// reloads the compare register with the period until the next pulse. While a motion runs, the ISR
+// checks the microswitch for the current direction of travel and the global pause flag before every
+// step, exactly as the old blocking pulse loop in Scara did.
+//
+// A microswitch stops the motor dead, but a pause brakes it: from the step that sees the flag, the
+// speed comes down at the motion's stop rate ("brake2", much harder than its acceleration), carrying
+// on through queued motions if need be, until one more step would stop it; only then does the axis
+// halt. Every step of the stop is counted, so the steps left are exact and the motion can be finished
+// from rest.
+//
+// The SCARA microswitches (pins 30-33) are all on port C, which has no pin-change interrupts on the
+// ATmega2560, so they cannot interrupt on their own. Instead the switch is resolved to a register and
+// mask when a motion starts, and each step costs a single port read. The motion stops on the step
+// where the switch is first seen closed, so the steps left (wait()) give the position at contact.
+//
+// For a combined motion the master's ISR also steps the slave axis and watches the slave's microswitch;
+// the slave reports its own status and remaining steps as if it had run the motion itself.
+//
+// Two axes can also run separate motions on their own timers with one starting the other: the partner
+// holds its motion until the lead reaches the cue point of a profile flagged "cue": its start, or a
+// number of steps before its end, so one motor can set off while the other is still slowing down to
+// finish (a blended corner). Until both are idle again, an axis
+// that halts stops its partner too (status 3, or -1 for a pause), so a switch on either one stops the
+// arm, as it does for a combined motion.
+//
+// Timer3 and Timer4 have identical register layouts, so the Timer3 bit names are used for both.
+//
+// The ISR never uses floating point: speeds are tracked squared and advanced by a constant per step,
+// and the period for a speed comes from the reciprocal square root table in RampTable.h. An S-curve
+// adds one 16x16 multiply per step: the change per step grows by the jerk times the step period, so
+// the acceleration ramps at a fixed rate in time however fast the motor is turning. Its phase lengths
+// are planned a little long; in the acceleration phase the speed stops at the cruise speed, and in
+// the deceleration phase it never drops below a gentle ramp down to the end speed, so rounding in
+// the ramps costs a few steps at cruise or on that ramp rather than a crawl to the end.
+
+#include "Axis.h"
+#include "RampTable.h"
+
+// Constructor: Look up the registers for the requested timer and provide default values
+Axis::Axis(int timer, PinRef dPin, PinRef pPin, PinRef plus, PinRef minus, volatile bool *pFlag) {
+    switch (timer) {
+      case (4): {
+        tccrA = &TCCR4A; tccrB = &TCCR4B; timsk = &TIMSK4; tifr = &TIFR4;
+        tcnt = &TCNT4; ocr = &OCR4A;
+        break;
+      }
+      default: { // Timer3
+        tccrA = &TCCR3A; tccrB = &TCCR3B; timsk = &TIMSK3; tifr = &TIFR3;
+        tcnt = &TCNT3; ocr = &OCR3A;
+        break;
+      }
+    }
+
+    dirPin = dPin;
+    pulsePin = pPin;
+    plsPin = plus;
+    minPin = minus;
+    watch(1);
+    pauseFlag = pFlag; // Set global pause flag reference
+
+    head = 0;
+    tail = 0;
+    running = false;
+    errorCode = 0;
+    stepsLeft = 0;
+    remaining = 0;
+    slave = NULL;
+    slaveLeft = 0;
+    partner = NULL;
+    ramp = 0;
+    rampCarry = 0;
+    stopping = false;
+#ifdef STEP_TRACE
+    traceAxis = (timer == 4) ? 1 : 0;
+    scheduled = 0;
+#endif
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ ******************************************************************************/
+bool Axis::push(const Profile &profile) {
+    uint8_t next = (tail + 1) % QUEUE_SIZE;
+    if (next == head) {return false;} // Queue full
+
+    queue[tail] = profile;
+
+    uint8_t oldSREG = SREG;
+    cli();
+    tail = next;
+    if (!running) { // Timer is idle; start this motion now
+      errorCode = 0;
+      remaining = 0;
+      load();
+    }
+    SREG = oldSREG;
+    return true;
+}
+
+bool Axis::hold(const Profile &profile, Axis &lead) {
+    if (busy() || lead.busy()) {return false;}
+
+    uint8_t oldSREG = SREG;
+    cli();
+    queue[tail] = profile; // The queue is empty, so there is room
+    tail = (tail + 1) % QUEUE_SIZE;
+    errorCode = 0;
+    remaining = 0;
+    partner = &lead;
+    lead.partner = this;
+    SREG = oldSREG;
+    return true;
+}
+
+bool Axis::busy() {
+    return running || (head != tail); // A held motion sits in the queue with the timer off
+}
+
+long Axis::wait() {
+    while (busy()) {
+#ifdef STEP_TRACE
+      stepTrace.drain(); // Keep the ring buffer from filling up during long moves
+#endif
+      yield(); // Let anything else that is waiting on us run
+    }
+    return remaining;
+}
+
+int Axis::status() {
+    return errorCode;
+}
+
+void Axis::isr() {
+    // Check the limit switch for the current direction of travel
+    if (tripped()) {
+      halt(switchCode);
+      return;
+    }
+    if ((slave != NULL) && slave->tripped()) { // Same for the slave axis
+      slave->errorCode = slave->switchCode;
+      halt(3);
+      return;
+    }
+    if (*pauseFlag && !stopping) { // If pause flag is flipped, start braking from the current speed
+      stopping = true;
+      stopSpeed2 = speed2;
+    }
+    if (stopping && (stopSpeed2 <= (queue[head].brake2 >> 1))) { // Slow enough to stop on the spot
+      halt(-1);
+      return;
+    }
+
+    pulsePin.high();
+    stepsLeft--;
+    if (queue[head].cue && (stepsLeft == queue[head].cueSteps) && (partner != NULL) && !stopping) {
+      partner->go(); // Blended corner: the partner sets off before this motion ends
+    }
+#ifdef STEP_TRACE
+    stepTrace.record(traceAxis, scheduled); // Time this pulse against the period it was scheduled with
+#endif
+
+    // Step the slave when its share of this step carries the error term over
+    Axis *stepped = NULL;
+    if (slave != NULL) {
+      slaveError -= queue[head].slaveSteps;
+      if (slaveError < 0) {
+        slaveError += slaveTotal;
+        slave->pulsePin.high();
+        slaveLeft--;
+        stepped = slave;
+      }
+    }
+
+    if (--phaseLeft <= 0) {
+      nextPhase(); // May load the next queued motion or stop the timer
+    }
+    if (running) {
+      uint16_t ticks = nextPeriod();
+      *ocr = ticks - 1; // Schedule the next step
+#ifdef STEP_TRACE
+      scheduled = ticks;
+#endif
+    }
+
+    pulsePin.low();
+    if (stepped != NULL) {stepped->pulsePin.low();}
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS (interrupts must be disabled)
+ ******************************************************************************/
+void Axis::load() {
+    while (head != tail) {
+      const Profile &p = queue[head];
+      stepsLeft = p.accelSteps + p.constSteps + p.decelSteps;
+      if (stepsLeft > 0) {
+        // Set direction and pick the microswitch we are travelling towards
+        dirPin.write(p.dir > 0);
+        watch(p.dir);
+
+        slave = p.slave;
+        if (slave != NULL) {
+          slaveLeft = p.slaveSteps;
+          slaveTotal = stepsLeft;
+          slaveError = stepsLeft/2;
+          slave->follow(p.slaveDir);
+        }
+
+        phase = -1;
+        phaseLeft = 0;
+        nextPhase();
+        if (p.cue && (p.cueSteps >= stepsLeft) && (partner != NULL) && !stopping) {partner->go();}
+        return;
+      }
+      head = (head + 1) % QUEUE_SIZE; // Skip empty motions
+    }
+
+    // Nothing left to run. Braking for a pause can run out the queue before the cue; drop the held motion.
+    if ((partner != NULL) && stopping) {partner->abort(-1);}
+    *timsk &= ~(1 << OCIE3A);
+    running = false;
+    stopping = false;
+    partner = NULL;
+}
+
+void Axis::nextPhase() {
+    const Profile &p = queue[head];
+    while (phaseLeft <= 0) {
+      phase++;
+      switch (phase) {
+        case (0): {phaseLeft = p.accelSteps; speed2 = p.startSpeed2; ramp = 0; break;}
+        case (1): {phaseLeft = p.constSteps; speed2 = p.maxSpeed2; break;}
+        case (2): {phaseLeft = p.decelSteps; speed2 = p.maxSpeed2; ramp = 0; break;}
+        default: { // Motion complete; move on to the next one
+          release();
+          head = (head + 1) % QUEUE_SIZE;
+          load();
+          return;
+        }
+      }
+    }
+
+    if (!running) {
+      startTimer(nextPeriod());
+    }
+}
+
+uint16_t Axis::nextPeriod() {
+    const Profile &p = queue[head];
+    if (stopping) { // Braking for a pause; the profile no longer sets the speed
+      uint16_t ticks = period(stopSpeed2);
+      unsigned long rest2 = p.brake2 >> 1;
+      stopSpeed2 = (stopSpeed2 > rest2 + p.brake2) ? stopSpeed2 - p.brake2 : rest2;
+      return ticks;
+    }
+
+    uint16_t ticks = period(speed2);
+
+    // Advance the speed along the profile by one step
+    if (phase == 0) {
+      if (p.jerk == 0) {speed2 += p.accel2;}
+      else {speed2 = min(speed2 + sCurve(ticks, speed2 >= p.accelEase2), p.maxSpeed2);}
+    }
+    else if (phase == 2) {
+      unsigned long change = (p.jerk == 0) ? p.accel2 : sCurve(ticks, speed2 <= p.decelEase2);
+      if (speed2 > p.endSpeed2 + change) {speed2 -= change;}
+      else {speed2 = p.endSpeed2;}
+      if (p.jerk != 0) { // Keep going on at least a quarter of the acceleration to the end
+        unsigned long floor2 = p.endSpeed2 + (p.accel2 >> 3)*phaseLeft;
+        if ((floor2 > speed2) && (floor2 < speed2 + change)) {speed2 = floor2;}
+      }
+    }
+
+    return ticks;
+}
+
+unsigned long Axis::sCurve(uint16_t ticks, bool easing) {
+    // Build the change per step up to accel2 at the jerk rate, or let it die away again when easing
+    const Profile &p = queue[head];
+    unsigned long jerkStep = (unsigned long)(p.jerk)*ticks;
+    if (easing) {ramp = (ramp > jerkStep) ? ramp - jerkStep : 0;}
+    else {ramp = min(ramp + jerkStep, p.accel2 << 16);}
+
+    // Whole units go to the speed now, the fraction is carried over to the next step
+    unsigned long total = ramp + rampCarry;
+    rampCarry = total & 0xFFFF;
+    return total >> 16;
+}
+
+uint16_t Axis::period(unsigned long v2) {
+    // Scale the speed squared by powers of four into the table range; each one halves the period
+    if (v2 < (unsigned long)(RAMP_TABLE_MAX)) {return MAX_PERIOD;} // Slower than 32 steps/s
+    uint8_t shift = 0;
+    while (v2 >= (unsigned long)(RAMP_TABLE_MAX)) {
+      v2 >>= 2;
+      shift++;
+    }
+    uint16_t half = pgm_read_word(&RAMP_HALF_PERIOD[(uint16_t)(v2) - RAMP_TABLE_MIN]);
+
+    // The table holds half periods, so the result is the table value shifted one less (rounded)
+    if (shift == 1) {return half;}
+    return (half + (1 << (shift - 2))) >> (shift - 1);
+}
+
+void Axis::halt(int code) {
+    *timsk &= ~(1 << OCIE3A);
+    running = false;
+    stopping = false;
+    errorCode = code;
+
+    // Report what was left of the running motion and anything queued behind it, then throw that away
+    long left = stepsLeft;
+    for (uint8_t i = (head + 1) % QUEUE_SIZE; i != tail; i = (i + 1) % QUEUE_SIZE) {
+      left += queue[i].accelSteps + queue[i].constSteps + queue[i].decelSteps;
+    }
+    remaining = (long)(queue[head].dir)*left;
+    release();
+    head = tail;
+    pulsePin.low();
+
+    // Take the partner down too; it does not pass it back
+    Axis *other = partner;
+    partner = NULL;
+    if ((other != NULL) && (code != 3)) {other->abort((code < 0) ? code : 3);}
+}
+
+void Axis::go() {
+    if (running || (head == tail)) {return;}
+    errorCode = 0;
+    remaining = 0;
+    load();
+}
+
+void Axis::abort(int code) {
+    partner = NULL;
+    if (running) {
+      if (code != -1) {halt(code);} // A running partner brakes for a pause by itself
+      return;
+    }
+    if (head == tail) {return;} // Already idle
+
+    // The held motion never started, so all of it is left
+    const Profile &p = queue[head];
+    remaining = (long)(p.dir)*(p.accelSteps + p.constSteps + p.decelSteps);
+    errorCode = code;
+    head = tail;
+}
+
+void Axis::kill(int code) {
+    partner = NULL; // The caller stops both axes itself
+    if (running) {halt(code);}
+    else {abort(code);}
+}
+
+void Axis::follow(int dir) {
+    dirPin.write(dir > 0);
+    watch(dir);
+    errorCode = 0;
+    remaining = 0;
+}
+
+void Axis::watch(int dir) {
+    // Resolve the switch to a register and mask once per motion, so each step reads one byte
+    const PinRef &pin = (dir > 0) ? plsPin : minPin;
+    switchIn = pin.in;
+    switchMask = pin.mask;
+    switchCode = (dir > 0) ? 1 : 2;
+}
+
+bool Axis::tripped() {
+    FASTPIN_READ(*switchIn);
+    return !(*switchIn & switchMask); // Switches close to ground
+}
+
+void Axis::release() {
+    if (slave == NULL) {return;}
+    slave->remaining = (long)(queue[head].slaveDir)*slaveLeft;
+    slave = NULL;
+}
+
+void Axis::startTimer(uint16_t period) {
+    *timsk &= ~(1 << OCIE3A);
+    *tccrA = 0;                               // Normal port operation, no PWM
+    *tccrB = (1 << WGM32) | (1 << CS31);      // CTC mode on OCRnA, /8 prescaler
+    *tcnt = 0;
+    *ocr = period - 1;
+#ifdef STEP_TRACE
+    scheduled = 0;                            // Nothing to time the first step against
+#endif
+    *tifr = (1 << OCF3A);                     // Clear any stale compare match
+    *timsk |= (1 << OCIE3A);                  // Enable compare match interrupt
+    running = true;
+}
@@ -0,0 +1,134 @@
+#ifndef AXIS_H
+#define AXIS_H
+
+#include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+#include "FastPin.h"
+#include "StepTrace.h"
+
+class Axis;
+
+// One queued motion for a single stepper axis. The step ISR works through the three phases in order:
+// "accelSteps" pulses speeding up from the start speed, "constSteps" pulses at the cruise speed, and
+// "decelSteps" pulses slowing back down. Speeds are kept squared so that the ISR only ever adds or
+// subtracts "accel2" per step (v^2 = v0^2 + 2*a*steps); there is no floating point in the step loop.
+//
+// An S-curve motion (jerk != 0) does not switch its acceleration on and off: within the acceleration
+// and deceleration phases the rate of change of speed itself ramps up at the jerk limit, holds, and
+// ramps back down once the speed passes the "ease" point, so the motor never sees a step in torque.
+//
+// A motion can also drive a second "slave" axis: the slave's steps are spread evenly over the master's
+// steps (Bresenham/DDA), so both axes start and finish together. The slave must not have more steps
+// than the master, and its own timer stays idle for the whole motion.
+//
+// Motions queued back to back run without a stop in between when the end speed of one matches the
+// start speed of the next. A motion flagged "cue" also starts the motion held on the partner axis
+// (see Axis::hold()) when "cueSteps" of it are left: at the moment it begins if that is all of it, so
+// the partner can set off from rest while this axis carries on through the junction, or part way
+// through its deceleration, so the partner sets off before this axis has come to rest.
+struct Profile {
+    int dir;                    // Direction of travel: 1 = positive, -1 = negative
+    long accelSteps;            // Number of steps in the acceleration phase
+    long constSteps;            // Number of steps in the constant speed phase
+    long decelSteps;            // Number of steps in the deceleration phase
+    unsigned long startSpeed2;  // Square of the speed at the start of the motion; (steps per second)^2
+    unsigned long endSpeed2;    // Square of the speed at the end of the motion; (steps per second)^2
+    unsigned long maxSpeed2;    // Square of the cruise speed; (steps per second)^2
+    unsigned long accel2;       // Change in speed squared per step (twice the acceleration rate)
+    unsigned long brake2;       // Change in speed squared per step when braking for a pause
+    uint16_t jerk;              // S-curve: growth of the change per step, per timer tick (1/65536ths); 0 = trapezoid
+    unsigned long accelEase2;   // S-curve: speed squared at which the acceleration starts to die away
+    unsigned long decelEase2;   // S-curve: speed squared at which the deceleration starts to die away
+    Axis *slave;                // Axis stepped along with this one, or NULL
+    int slaveDir;               // Slave direction of travel: 1 = positive, -1 = negative
+    long slaveSteps;            // Number of slave steps; no more than the total steps above
+    bool cue;                   // Start the partner's held motion during this one
+    long cueSteps;              // Steps left in this motion when "cue" starts the partner (all of them: at the start)
+};
+
+// Timer-driven step generator for one stepper motor. Each axis owns one 16-bit hardware timer
+// (Timer3 or Timer4) running in CTC mode; every compare match emits one pulse and reloads the
+// compare register with the period of the next step. The foreground only queues profiles.
+class Axis {
+
+    public:
+        Axis(int timer, PinRef dirPin, PinRef pulsePin, PinRef plsPin, PinRef minPin, volatile bool *pFlag); // Constructor
+        bool push(const Profile &profile); // Queue a motion; returns false if the queue is full
+        bool hold(const Profile &profile, Axis &lead); // Queue a motion for "lead" to start; both must be idle
+        bool busy();                       // True while a motion is running, queued or held
+        long wait();                       // Block until idle; return signed steps left unrun
+        int status();                      // 0 = nominal, 1 = "plus" switch, 2 = "minus" switch, -1 = paused (after braking),
+                                           // 3 = stopped because the slave or partner axis hit a switch
+        void isr();                        // Compare-match handler; only call from the timer ISR
+        void kill(int code);               // Stop dead without braking; only call from another ISR
+
+
+    private:
+        // Timer constants (16 MHz clock with a /8 prescaler: 2 ticks per microsecond)
+        static const uint16_t MAX_PERIOD = 65535; // Longest period the 16-bit compare register can hold
+
+        static const int QUEUE_SIZE = 4;      // Number of motions that can be queued (one is running)
+
+        // Hardware
+        volatile uint8_t *tccrA;              // Timer control register A
+        volatile uint8_t *tccrB;              // Timer control register B
+        volatile uint8_t *timsk;              // Timer interrupt mask register
+        volatile uint8_t *tifr;               // Timer interrupt flag register
+        volatile uint16_t *tcnt;              // Timer counter
+        volatile uint16_t *ocr;               // Timer output compare register A
+        PinRef dirPin;                        // OUTPUT, motor "direction" pin
+        PinRef pulsePin;                      // OUTPUT, motor "pulse" pin
+        PinRef plsPin;                        // INPUT, "plus" microswitch
+        PinRef minPin;                        // INPUT, "minus" microswitch
+        volatile bool *pauseFlag;             // Reference to global pause flag
+
+        // Motion queue, shared with the ISR. The ISR only advances "head"; push() only advances "tail".
+        Profile queue[QUEUE_SIZE];
+        volatile uint8_t head;                // Index of the running motion
+        volatile uint8_t tail;                // Index of the next free slot
+        volatile bool running;                // True while the timer interrupt is enabled
+
+        // ISR state for the running motion
+        int phase;                            // 0 = accelerating, 1 = constant speed, 2 = decelerating
+        long phaseLeft;                       // Steps left in the current phase
+        unsigned long speed2;                 // Square of the current speed; (steps per second)^2
+        unsigned long ramp;                   // S-curve: current change in speed squared per step (1/65536ths)
+        uint16_t rampCarry;                   // S-curve: fraction of "ramp" not yet added to the speed
+        bool stopping;                        // Braking to a standstill for a pause
+        unsigned long stopSpeed2;             // Square of the speed while braking
+        long stepsLeft;                       // Steps left in the running motion
+        volatile long remaining;              // Signed steps left unrun (including motions thrown away)
+        volatile int errorCode;               // Reason the last motion stopped, see status()
+        volatile uint8_t *switchIn;           // PINx register of the microswitch for the current direction
+        uint8_t switchMask;                   // Its bit; all four SCARA switches share port C
+        uint8_t switchCode;                   // Status to report if it closes: 1 = "plus," 2 = "minus"
+#ifdef STEP_TRACE
+        uint8_t traceAxis;                    // Axis index for StepTrace; 0 = rotational, 1 = linear
+        uint16_t scheduled;                   // Period the next step was scheduled with; 0 = first step
+#endif
+
+        // ISR state for the slave of the running motion (see Profile)
+        Axis *slave;                          // Slave axis, or NULL
+        long slaveLeft;                       // Slave steps left
+        long slaveTotal;                      // Total steps of the running motion (the DDA denominator)
+        long slaveError;                      // Bresenham error term; a slave step is due when it goes negative
+
+        // Axis running alongside this one on its own timer (see hold()); each stops the other if it halts
+        Axis *partner;                        // Partner axis, or NULL
+
+        // Private functions
+        void load();                          // Start the motion at the head of the queue
+        void nextPhase();                     // Advance to the next non-empty phase, or the next motion
+        uint16_t nextPeriod();                // Period until the next step; advances the speed
+        static uint16_t period(unsigned long speed2); // Step period in ticks for a speed squared
+        unsigned long sCurve(uint16_t ticks, bool easing); // S-curve change in speed squared for one step
+        void halt(int code);                  // Stop the timer and throw away queued motions
+        void go();                            // Start a held motion; called by the partner's ISR
+        void abort(int code);                 // Stop for the partner: halt, or drop a held motion
+        void follow(int dir);                 // Prepare this axis to be stepped as a slave
+        void watch(int dir);                  // Pick the microswitch for a direction of travel
+        bool tripped();                       // True if the watched microswitch is closed
+        void release();                       // Hand the slave its result when the motion ends
+        void startTimer(uint16_t period);     // Configure and enable the timer
+};
+
+#endif
@@ -0,0 +1,75 @@
+// Stop path for the pause button; see EStop.h. Everything that decides when the arm stops runs in
+// interrupts (the pause ISR, the step ISRs and the 1 ms tick), so the bound holds wherever the
+// foreground happens to be: in a wait loop, running a background task or writing the EEPROM.
+//
+// Cutting the power is the last resort. The drivers let go of the motors at once, so the vertical arm
+// is no longer held and neither motor's position can be trusted; Scara reports POWER_CUT and the arm
+// has to be homed with a full search after a reset.
+
+#include "EStop.h"
+
+// Constructor: Provide default values
+EStop::EStop(Scara *pScara, Linear *pLin) {
+    scara = pScara;
+    lin = pLin;
+    state = IDLE;
+    limit = scara->brakeTime() + MARGIN;
+    edge = 0;
+    ticks = 0;
+    last = 0;
+    worst = 0;
+    cut = false;
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ ******************************************************************************/
+void EStop::trigger() {
+    if (state != IDLE) {return;} // Already stopping, or stopped and not yet looked at
+    edge = micros();
+    ticks = 0;
+    cut = false;
+    lin->pauseISR();
+    state = STOPPING;
+}
+
+void EStop::tick() {
+    if (state != STOPPING) {return;}
+    ticks++;
+    if (scara->moving()) {
+      if (ticks < limit) {return;}
+      scara->cutPower(); // Out of time; stop the steppers dead
+      cut = true;
+    }
+    last = micros() - edge;
+    if (last > worst) {worst = last;}
+    state = STOPPED;
+}
+
+bool EStop::stopping() {
+    return state == STOPPING;
+}
+
+bool EStop::done() {
+    return state == STOPPED;
+}
+
+unsigned long EStop::latency() {
+    return last;
+}
+
+unsigned long EStop::worstLatency() {
+    return worst;
+}
+
+bool EStop::powerCut() {
+    return cut;
+}
+
+unsigned long EStop::deadline() {
+    return limit;
+}
+
+void EStop::clear() {
+    state = IDLE;
+}
@@ -0,0 +1,44 @@
+#ifndef ESTOP_H
+#define ESTOP_H
+
+#include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+#include "Scara.h"
+#include "Linear.h"
+
+// The stop path for the pause button, with a bound on how long it takes. The pause ISR calls
+// trigger(), which drops the cylinder relays on the spot; the steppers start braking on their next
+// step (they watch the pause flag). From then on the 1 ms tick watches the arm, and notes the time
+// from the button edge to the moment both steppers are at rest. If they are still moving after
+// Scara::brakeTime() plus MARGIN the tick cuts their power, so the arm is always stopped within that time.
+class EStop {
+
+    public:
+        EStop(Scara *pScara, Linear *pLin); // Constructor
+        void trigger();             // Start a stop; only call from the pause ISR, after the pause flag is set
+        void tick();                // Scheduler task, every ms in the tick interrupt
+        bool stopping();            // True while a stop is under way
+        bool done();                // True once a stop is over, until clear()
+        unsigned long latency();    // Time from the edge to standstill of the last stop (us)
+        unsigned long worstLatency(); // Longest of those so far (us)
+        bool powerCut();            // The last stop ran out of time and cut the stepper power
+        unsigned long deadline();   // Longest a stop may take before the power is cut (ms)
+        void clear();               // Ready for the next stop
+
+    private:
+        enum State {IDLE, STOPPING, STOPPED};
+        static const unsigned long MARGIN = 300; // Allowance past the braking time: the first step at a
+                                                 // slow speed, the last few steps of the brake (ms)
+
+        Scara *scara;
+        Linear *lin;
+
+        volatile uint8_t state;             // See State
+        unsigned long limit;                // Deadline in ticks (ms)
+        unsigned long edge;                 // micros() when the stop started
+        unsigned long ticks;                // Ticks since then
+        volatile unsigned long last;        // Latency of the last stop (us)
+        unsigned long worst;                // Longest latency so far (us)
+        volatile bool cut;                  // The last stop cut the power
+};
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef EEPROMMAP_H
+#define EEPROMMAP_H
+
+// Where each class keeps its data in the ATmega2560's 4 KB EEPROM. Every block starts with its own
+// version byte; a block whose version does not match is treated as blank, so changing one layout only
+// throws away that block.
+const int EEPROM_LINEAR = 0;            // Linear: learned cylinder travel times (1 + 6*6 bytes)
+const int EEPROM_SCARA = 64;            // Scara: arm position at rest (1 + 1 + 2*4 bytes)
+const int EEPROM_LOAD_PROFILE = 128;    // Profiler: last runs of the load program (3 + 8*40 bytes)
+const int EEPROM_HOME_PROFILE = 512;    // Profiler: last runs of the home program (3 + 8*40 bytes)
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef FASTPIN_H
+#define FASTPIN_H
+
+#include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+
+// Compile-time pin access for the ATmega2560, using Arduino Mega pin numbers.
+//
+// FastPin<N> looks up the port and bit of pin N when the sketch is compiled, so writing the pin is a
+// single "sbi"/"cbi" instruction instead of a trip through digitalWrite. Ports H, J, K and L sit
+// outside the range of those instructions, so writes there (and any write of more than one bit) are
+// a read-modify-write done with interrupts held off; ISRs write the same ports.
+//
+// FastPins<A, B, ...> writes several pins on the same port with one store, e.g. all six linear relays.
+// PinRef carries a pin resolved this way into code that picks its pin at runtime (like Axis).
+//
+// Using a pin that is not in the table below is a compile error.
+
+/*******************************************************************************
+ * PORTS
+ ******************************************************************************/
+// The host simulator (sim/) defines these to watch the port registers; on the AVR they do nothing
+#ifndef FASTPIN_WRITTEN
+#define FASTPIN_WRITTEN(reg)
+#endif
+#ifndef FASTPIN_READ
+#define FASTPIN_READ(reg)
+#endif
+
+#define FASTPIN_PORT(NAME, BIT_IO) \
+    struct Port##NAME { \
+        static volatile uint8_t &out() {return PORT##NAME;} \
+        static volatile uint8_t &in() {return PIN##NAME;} \
+        static volatile uint8_t &ddr() {return DDR##NAME;} \
+        static const bool BIT_INSTRUCTIONS = BIT_IO; \
+    };
+
+FASTPIN_PORT(A, true)
+FASTPIN_PORT(B, true)
+FASTPIN_PORT(C, true)
+FASTPIN_PORT(D, true)
+FASTPIN_PORT(E, true)
+FASTPIN_PORT(F, true)
+FASTPIN_PORT(G, true)
+FASTPIN_PORT(H, false)
+FASTPIN_PORT(J, false)
+FASTPIN_PORT(K, false)
+FASTPIN_PORT(L, false)
+
+/*******************************************************************************
+ * PIN MAP (Arduino Mega 2560)
+ ******************************************************************************/
+template<int N> struct PinMap; // Only the pins below are defined
+
+#define FASTPIN_MAP(N, PORT, BIT) \
+    template<> struct PinMap<N> { \
+        typedef Port##PORT Port; \
+        static const uint8_t MASK = (1 << BIT); \
+    };
+
+FASTPIN_MAP(0, E, 0)   FASTPIN_MAP(1, E, 1)   FASTPIN_MAP(2, E, 4)   FASTPIN_MAP(3, E, 5)
+FASTPIN_MAP(4, G, 5)   FASTPIN_MAP(5, E, 3)   FASTPIN_MAP(6, H, 3)   FASTPIN_MAP(7, H, 4)
+FASTPIN_MAP(8, H, 5)   FASTPIN_MAP(9, H, 6)   FASTPIN_MAP(10, B, 4)  FASTPIN_MAP(11, B, 5)
+FASTPIN_MAP(12, B, 6)  FASTPIN_MAP(13, B, 7)  FASTPIN_MAP(14, J, 1)  FASTPIN_MAP(15, J, 0)
+FASTPIN_MAP(16, H, 1)  FASTPIN_MAP(17, H, 0)  FASTPIN_MAP(18, D, 3)  FASTPIN_MAP(19, D, 2)
+FASTPIN_MAP(20, D, 1)  FASTPIN_MAP(21, D, 0)  FASTPIN_MAP(22, A, 0)  FASTPIN_MAP(23, A, 1)
+FASTPIN_MAP(24, A, 2)  FASTPIN_MAP(25, A, 3)  FASTPIN_MAP(26, A, 4)  FASTPIN_MAP(27, A, 5)
+FASTPIN_MAP(28, A, 6)  FASTPIN_MAP(29, A, 7)  FASTPIN_MAP(30, C, 7)  FASTPIN_MAP(31, C, 6)
+FASTPIN_MAP(32, C, 5)  FASTPIN_MAP(33, C, 4)  FASTPIN_MAP(34, C, 3)  FASTPIN_MAP(35, C, 2)
+FASTPIN_MAP(36, C, 1)  FASTPIN_MAP(37, C, 0)  FASTPIN_MAP(38, D, 7)  FASTPIN_MAP(39, G, 2)
+FASTPIN_MAP(40, G, 1)  FASTPIN_MAP(41, G, 0)  FASTPIN_MAP(42, L, 7)  FASTPIN_MAP(43, L, 6)
+FASTPIN_MAP(44, L, 5)  FASTPIN_MAP(45, L, 4)  FASTPIN_MAP(46, L, 3)  FASTPIN_MAP(47, L, 2)
+FASTPIN_MAP(48, L, 1)  FASTPIN_MAP(49, L, 0)  FASTPIN_MAP(50, B, 3)  FASTPIN_MAP(51, B, 2)
+FASTPIN_MAP(52, B, 1)  FASTPIN_MAP(53, B, 0)
+
+/*******************************************************************************
+ * PORT BIT OPERATIONS
+ ******************************************************************************/
+// Writes to the bits in MASK of one port. A single bit on ports A-G compiles to one instruction and
+// cannot be torn by an interrupt; everything else is protected.
+template<class PORT, uint8_t MASK>
+struct PortBits {
+    static const bool ATOMIC = PORT::BIT_INSTRUCTIONS && ((MASK & (MASK - 1)) == 0);
+
+    static void high() {
+      if (ATOMIC) {PORT::out() |= MASK; FASTPIN_WRITTEN(PORT::out()); return;}
+      uint8_t oldSREG = SREG; cli();
+      PORT::out() |= MASK;
+      FASTPIN_WRITTEN(PORT::out());
+      SREG = oldSREG;
+    }
+
+    static void low() {
+      if (ATOMIC) {PORT::out() &= ~MASK; FASTPIN_WRITTEN(PORT::out()); return;}
+      uint8_t oldSREG = SREG; cli();
+      PORT::out() &= ~MASK;
+      FASTPIN_WRITTEN(PORT::out());
+      SREG = oldSREG;
+    }
+
+    static void write(uint8_t value) {
+      if (value) {high();}
+      else {low();}
+    }
+
+    // Drive every pin in MASK to the matching bit of "bits" with one store, e.g. a nibble onto a data bus
+    static void set(uint8_t bits) {
+      uint8_t oldSREG = SREG; cli();
+      PORT::out() = (PORT::out() & ~MASK) | (bits & MASK);
+      FASTPIN_WRITTEN(PORT::out());
+      SREG = oldSREG;
+    }
+
+    static void toggle() {
+      PORT::in() = MASK; // Writing a one to a PINx bit flips the output
+      FASTPIN_WRITTEN(PORT::in());
+    }
+
+    static void output() {
+      uint8_t oldSREG = SREG; cli();
+      PORT::ddr() |= MASK;
+      FASTPIN_WRITTEN(PORT::ddr());
+      SREG = oldSREG;
+    }
+
+    static void inputPullup() {
+      uint8_t oldSREG = SREG; cli();
+      PORT::ddr() &= ~MASK;
+      PORT::out() |= MASK;
+      FASTPIN_WRITTEN(PORT::ddr());
+      SREG = oldSREG;
+    }
+
+    static void input() {
+      uint8_t oldSREG = SREG; cli();
+      PORT::ddr() &= ~MASK;
+      PORT::out() &= ~MASK;
+      FASTPIN_WRITTEN(PORT::ddr());
+      SREG = oldSREG;
+    }
+};
+
+/*******************************************************************************
+ * RUNTIME PIN HANDLE
+ ******************************************************************************/
+// A pin whose port and mask were resolved at compile time, for code that chooses pins at runtime.
+struct PinRef {
+    volatile uint8_t *out;      // PORTx register
+    volatile uint8_t *in;       // PINx register
+    uint8_t mask;               // Bit within the port
+
+    void high() const {
+      uint8_t oldSREG = SREG; cli();
+      *out |= mask;
+      FASTPIN_WRITTEN(*out);
+      SREG = oldSREG;
+    }
+
+    void low() const {
+      uint8_t oldSREG = SREG; cli();
+      *out &= ~mask;
+      FASTPIN_WRITTEN(*out);
+      SREG = oldSREG;
+    }
+
+    void write(uint8_t value) const {
+      if (value) {high();}
+      else {low();}
+    }
+
+    void toggle() const {*in = mask; FASTPIN_WRITTEN(*in);}
+    uint8_t read() const {FASTPIN_READ(*in); return (*in & mask) ? HIGH : LOW;}
+    uint8_t state() const {return (*out & mask) ? HIGH : LOW;} // Level an output pin is driven to
+};
+
+/*******************************************************************************
+ * PINS
+ ******************************************************************************/
+template<int N>
+struct FastPin : public PortBits<typename PinMap<N>::Port, PinMap<N>::MASK> {
+    typedef typename PinMap<N>::Port Port;
+    static const uint8_t MASK = PinMap<N>::MASK;
+
+    static uint8_t read() {FASTPIN_READ(Port::in()); return (Port::in() & MASK) ? HIGH : LOW;}
+    static uint8_t state() {return (Port::out() & MASK) ? HIGH : LOW;} // Level an output is driven to
+    static bool stuck() {return read() != state();} // An output is not at the level it is driven to (shorted)
+
+    static PinRef ref() {
+      PinRef pin = {&Port::out(), &Port::in(), MASK};
+      return pin;
+    }
+};
+
+// Compile-time check that every pin of a FastPins group is on the same port
+template<class A, class B> struct SamePort {static const bool value = false;};
+template<class A> struct SamePort<A, A> {static const bool value = true;};
+
+template<int... PINS> struct PinGroup;
+
+template<int N>
+struct PinGroup<N> {
+    typedef typename PinMap<N>::Port Port;
+    static const uint8_t MASK = PinMap<N>::MASK;
+};
+
+template<int N, int... REST>
+struct PinGroup<N, REST...> {
+    typedef typename PinMap<N>::Port Port;
+    static const uint8_t MASK = PinMap<N>::MASK | PinGroup<REST...>::MASK;
+    static_assert(SamePort<Port, typename PinGroup<REST...>::Port>::value,
+        "FastPins: all pins in a group must be on the same port");
+};
+
+template<int... PINS>
+struct FastPins : public PortBits<typename PinGroup<PINS...>::Port, PinGroup<PINS...>::MASK> {
+};
+
+#endif
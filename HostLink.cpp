@@ -0,0 +1,155 @@
+// Streaming motion commands from a host over the serial port; see HostLink.h for the protocol. The
+// reference client and a pseudo-terminal stand-in for the board are in sim/ (agse_stream, agse_sim -p).
+
+#include "HostLink.h"
+
+// Constructor: Provide default values
+HostLink::HostLink(Scara *pScara, volatile bool *pFlag) {
+    scara = pScara;
+    pauseFlag = pFlag; // Set global pause flag reference
+    head = 0;
+    count = 0;
+    length = 0;
+    overlong = false;
+    session = false;
+    ended = false;
+    heard = 0;
+}
+
+bool HostLink::parse(const char *&text, long &value) {
+    while (*text == ' ') {text++;}
+    char *end;
+    value = strtol(text, &end, 10);
+    if (end == text) {return false;}
+    text = end;
+    return true;
+}
+
+void HostLink::command() {
+    const char *text = line;
+    long rot, lin, blend = 0;
+    switch (*text++) {
+      case 'M':
+        if (!parse(text, rot) || !parse(text, lin) || ((*text != 0) && !parse(text, blend)) || (*text != 0) ||
+            (abs(rot) > MAX_DISTANCE) || (abs(lin) > MAX_DISTANCE) || (blend < 0) || (blend > MAX_DISTANCE)) {break;}
+        ring[(head + count) % RING_SIZE].rot = rot;
+        ring[(head + count) % RING_SIZE].lin = lin;
+        ring[(head + count) % RING_SIZE].blend = blend;
+        count++;
+        Serial.println(F("ok"));
+        return;
+      case 'E':
+        if (*text != 0) {break;}
+        ended = true;
+        Serial.println(F("ok"));
+        return;
+      case '?':
+        if (*text != 0) {break;}
+        Serial.println(F("ok"));
+        return;
+    }
+    Serial.println(F("bad"));
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ ******************************************************************************/
+void HostLink::begin() {
+    Serial.begin(BAUD);
+}
+
+bool HostLink::waiting() {
+    return !session && (Serial.available() > 0);
+}
+
+void HostLink::poll() {
+    if (!session) {return;} // Between sessions, commands wait in the serial buffer
+    // Stop reading while the ring is full; the host is waiting for the answer to its last motion
+    while ((count < RING_SIZE) && (Serial.available() > 0)) {
+      char c = Serial.read();
+      if (c == '\r') {continue;}
+      if (c != '\n') {
+        if (length < LINE_SIZE - 1) {line[length++] = c;}
+        else {overlong = true;}
+        continue;
+      }
+      line[length] = 0;
+      heard = millis();
+      if (overlong) {Serial.println(F("bad"));}
+      else if (length > 0) {command();}
+      length = 0;
+      overlong = false;
+    }
+}
+
+int HostLink::run() {
+    session = true;
+    ended = false;
+    head = 0;
+    count = 0;
+    scara->clearMotions();
+    heard = millis(); // The line that started the session is still to be read
+
+    unsigned long motions = 0;
+    unsigned long underruns = 0;
+    unsigned long starved = 0;              // Time the arm spent waiting on the host (ms)
+    unsigned long started = millis();
+    unsigned long starvedSince = 0;
+    bool starving = false;
+    int errState = 0;
+
+    while (true) {
+      poll();
+      if (*pauseFlag) {errState = -1; break;}
+
+      // Hand the arm as many motions as it can look ahead through
+      while ((count > 0) && scara->addMotion(ring[head].rot, ring[head].lin, ring[head].blend)) {
+        head = (head + 1) % RING_SIZE;
+        count--;
+      }
+
+      if (scara->motionsQueued() == 0) {
+        if (ended) {break;}
+        // Only count it once the host has started sending motions
+        if ((motions > 0) && !starving) {
+          starving = true;
+          starvedSince = millis();
+          underruns++;
+        }
+        if (millis() - heard >= HOST_TIMEOUT) {errState = TIMED_OUT; break;}
+        yield(); // Sleep until the next tick; the background tasks (this one's poll() too) keep running
+        continue;
+      }
+      if (starving) {
+        starved += millis() - starvedSince;
+        starving = false;
+      }
+
+      int before = scara->motionsQueued();
+      errState = scara->runNext(); // Commands keep coming in (poll() runs from yield()) while the arm runs
+      motions += before - scara->motionsQueued();
+      if (errState != 0) {break;}
+    }
+
+    session = false;
+    scara->clearMotions();
+    if (errState != 0) {
+      // Whatever the host sent after the stop must not start another session
+      while (Serial.available() > 0) {Serial.read();}
+      length = 0;
+      overlong = false;
+    }
+    if (errState == -1) {
+      Serial.println(F("paused"));
+    }
+    else if (errState > 0) {
+      Serial.print(F("error ")); Serial.println(errState);
+    }
+    else {
+      Serial.print(F("end ")); Serial.print(motions);
+      Serial.print(' '); Serial.print(underruns);
+      Serial.print(' '); Serial.print(starved);
+      Serial.print(' '); Serial.println(millis() - started);
+    }
+    return errState;
+}
@@ -0,0 +1,72 @@
+#ifndef HOSTLINK_H
+#define HOSTLINK_H
+
+#include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+#include "Scara.h"
+
+// Streams SCARA motions from a host computer over the serial port, one command per line:
+//
+//   M <rot> <lin> [<blend>]
+//                   queue a motion, in hundredths of a degree and cm (both arms move together); a motion
+//                   of one arm may have a blend, how far before its end the next motion may start
+//   E               end of stream; run out the queue, then report
+//   ?               do nothing (check the board is listening)
+//
+// Every command is answered with "ok" once it has been taken, or "bad" if it could not be read. Only
+// send the next command after the answer to the last one; the board stops reading while its queue is
+// full, so the answer is also the flow control. A session ends with one of:
+//
+//   end <motions> <underruns> <starved ms> <run ms>
+//   paused          the pause button was pressed; the rest of the queue was dropped
+//   error <code>    a microswitch was hit, or the motor power was cut (codes as for Scara), or 10: the
+//                   host sent nothing for HOST_TIMEOUT while the arm had nothing to run
+//
+// Lines the host does not recognise (debug output) should be ignored.
+//
+// The queue is double-buffered: commands are read into a ring while the arm runs (poll() is a background
+// task of the sketch's scheduler, which the motion waits run through yield()), and the arm's own queue is
+// topped up from the ring before each move, so the look-ahead in Scara sees the next motions and runs
+// through them where it can. An underrun is the arm running out of motions before the host has ended
+// the stream.
+class HostLink {
+
+    public:
+        HostLink(Scara *pScara, volatile bool *pFlag); // Constructor
+        void begin();               // Open the serial port
+        bool waiting();             // True if the host has sent something while no session is running
+        int run();                  // Run a session until the host ends it; 0 = done, -1 = paused, 1-4, 8 = error,
+                                    // TIMED_OUT = the host went quiet
+        void poll();                // Read any complete commands; scheduler task, every ms in the background
+
+        static const int TIMED_OUT = 10;    // run() error: the host went quiet part way through a session
+
+    private:
+        static const long BAUD = 115200;
+        static const int RING_SIZE = 8;     // Motions buffered ahead of the arm's own queue
+        static const int LINE_SIZE = 24;    // Longest command line, with its terminator
+        static const long MAX_DISTANCE = CENTI(360); // Largest distance a motion may ask for
+        static const unsigned long HOST_TIMEOUT = 10000; // Longest the host may leave the arm with nothing to do (ms)
+
+        Scara *scara;
+        volatile bool *pauseFlag;           // Reference to global pause flag
+
+        struct Motion {
+            long rot;                       // Hundredths of a degree
+            long lin;                       // Hundredths of a cm
+            long blend;                     // Hundredths of a degree or cm (see Scara::addMotion())
+        };
+        Motion ring[RING_SIZE];
+        uint8_t head;                       // Next motion to hand to the arm
+        uint8_t count;                      // Motions in the ring
+        char line[LINE_SIZE];               // Command being read
+        uint8_t length;                     // Characters in "line"
+        bool overlong;                      // The command did not fit in "line"
+        bool session;                       // A session is running
+        bool ended;                         // The host has sent "E"
+        unsigned long heard;                // millis() at the last line from the host
+
+        void command();                     // Carry out the command in "line"
+        bool parse(const char *&text, long &value); // Read one signed number
+};
+
+#endif
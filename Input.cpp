@@ -1,39 +1,115 @@
-// Class to handle AGSE inputs: blue, green, yellow buttons
+// Class to handle AGSE inputs: blue (home), green (go) and yellow (pause) buttons
 //
-// Note that blue and green are standard inputs
-// Yellow will be tied to a interrupt routine
-// 
-
-// MODIFICATION
+// All three buttons are on external interrupts and interrupt on both edges. The edge ISR debounces
+// the button and queues a timestamped press for the main loop, so presses are kept in order rather
+// than being coalesced into flags. Only the first edge after the button has been quiet (no edge either
+// way) for DEBOUNCE_US counts, so contact bounce on press or release never makes a second one.
+//
+// Whether that first edge is a press or a release is decided by the level the button settled at, not
+// by the pin: the ISR can be held off by a step or tick interrupt and read a bounce. Each edge notes
+// the level it reads, and the last edge of a burst reads the pin after it has stopped changing, so
+// the noted level is the settled one by the time the next burst starts.
+//
+// The pause button also sets the global pause flag straight from its ISR. The step ISRs, the linear
+// actuator tick and every wait loop already watch that flag, so the arm starts braking on the next
+// step after the edge; the queued press is for the state machine to pick up once the motion is over.
+//
+// The main loop takes presses with next() and reports each one it acts on with handled(), which
+// keeps the worst latency from edge to action.
 
 #include "Input.h"
 
-// Constructor: Set all relevant pins to "input"
-Input::Input(){
-    pinMode(BUT_BLU_PIN, INPUT);
-    pinMode(BUT_GRN_PIN, INPUT);
-    pinMode(BUT_YEL_PIN, INPUT);
+// Constructor: Set all relevant pins to "input" and provide default values
+Input::Input(volatile bool *pFlag){
+    FastPin<HOME_PIN>::inputPullup();
+    FastPin<GO_PIN>::inputPullup();
+    FastPin<PAUSE_PIN>::inputPullup();
 
+    pauseFlag = pFlag; // Set global pause flag reference
+    head = 0;
+    tail = 0;
+    dropped = 0;
+    worst = 0;
+    for (int i = 0; i < 3; i++) {
+      lastEdge[i] = 0;
+      down[i] = false;
+    }
+}
+
+bool Input::edge(uint8_t button, bool pressed) {
+    unsigned long now = micros();
+    unsigned long quiet = now - lastEdge[button];
+    lastEdge[button] = now;
+    bool wasDown = down[button];
+    down[button] = pressed;
+    if (wasDown || (quiet < DEBOUNCE_US)) {return false;} // A release, or bounce
+
+    if (button == PAUSE) {*pauseFlag = true;} // Stop the motion now; the press is only for the state machine
+
+    uint8_t next = (tail + 1) % QUEUE_SIZE;
+    if (next == head) { // Full; the main loop has not looked for a while
+      if (dropped < 255) {dropped++;}
+      return true; // Still a press; a pause has stopped the motion all the same
+    }
+    queue[tail].button = button;
+    queue[tail].time = now;
+    tail = next; // Publish the press only once it is written
+    return true;
 }
 
 /*******************************************************************************
  * PUBLIC FUNCTIONS
  ******************************************************************************/
+void Input::attachButtons(void (*home)(void), void (*go)(void), void (*pause)(void)) {
+    down[HOME] = !FastPin<HOME_PIN>::read();
+    down[GO] = !FastPin<GO_PIN>::read();
+    down[PAUSE] = !FastPin<PAUSE_PIN>::read();
+    attachInterrupt(digitalPinToInterrupt(HOME_PIN), home, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(GO_PIN), go, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(PAUSE_PIN), pause, CHANGE);
+}
+
+bool Input::next(Event &event) {
+    if (head == tail) {return false;}
+    event = queue[head];
+    head = (head + 1) % QUEUE_SIZE; // Free the slot only once it is read
+    return true;
+}
+
+unsigned long Input::handled(const Event &event) {
+    unsigned long latency = micros() - event.time;
+    if (latency > worst) {worst = latency;}
+    return latency;
+}
+
+unsigned long Input::worstLatency() {
+    return worst;
+}
+
+uint8_t Input::lost() {
+    return dropped;
+}
+
+uint8_t Input::selfTest() {
+    // Nobody should be holding a button while the board boots, so one that reads pressed is stuck or
+    // shorted, and its edges would never come
+    uint8_t held = 0;
+    if (!FastPin<HOME_PIN>::read()) {held |= 1 << HOME;}
+    if (!FastPin<GO_PIN>::read()) {held |= 1 << GO;}
+    if (!FastPin<PAUSE_PIN>::read()) {held |= 1 << PAUSE;}
+    return held;
+}
 
 // When you write a "member" function of a class you must preface it with "Classname::memberFunction()" as
 // you see here
 int Input::Home() {
-    return digitalRead(BUT_BLU_PIN);
+    return FastPin<HOME_PIN>::read();
 }
 
 int Input::Start() {
-    return digitalRead(BUT_GRN_PIN);
+    return FastPin<GO_PIN>::read();
 }
 
 int Input::Pause() {
-// 
-    return digitalRead(BUT_YEL_PIN);
-// *** >>> This code block should ultimately contain the interrupt routine for PAUSE functionality
-//
+    return FastPin<PAUSE_PIN>::read();
 }
-
@@ -2,11 +2,32 @@
 #define INPUT_H
 
 #include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+#include "FastPin.h"
 
 class Input {
 
     public:
-        Input(); // Constructor
+        // Buttons
+        static const uint8_t HOME = 0;
+        static const uint8_t GO = 1;
+        static const uint8_t PAUSE = 2;
+
+        // One button press, as the edge ISR saw it
+        struct Event {
+            uint8_t button;                 // HOME, GO or PAUSE
+            unsigned long time;             // micros() at the edge
+        };
+
+        Input(volatile bool *pFlag); // Constructor
+        void attachButtons(void (*home)(void), void (*go)(void), void (*pause)(void)); // Attach the edge ISRs
+        bool next(Event &event);            // Take the oldest press; false if there is none
+        unsigned long handled(const Event &event); // Note a press has been acted on; returns its latency (us)
+        unsigned long worstLatency();       // Longest latency from edge to action so far (us)
+        uint8_t lost();                     // Presses dropped because the queue was full
+        uint8_t selfTest();                 // Boot check; bit (1 << button) set for each button held down
+        bool homeISR() { return edge(HOME, !FastPin<HOME_PIN>::read()); } // Pin-change handlers; only call from
+        bool goISR() { return edge(GO, !FastPin<GO_PIN>::read()); }       // the button's external interrupt.
+        bool pauseISR() { return edge(PAUSE, !FastPin<PAUSE_PIN>::read()); } // True for a press
 
         // dummy operations
         int Home();
@@ -18,9 +39,26 @@ class Input {
 
     private:
         // ADD ALL REQUIRED PINS AS CONST INT
-        const int BUT_BLU_PIN = 0;       // OUTPUT, red stack light
-        const int BUT_GRN_PIN = 18;       // OUTPUT, yellow stack light
-        const int BUT_YEL_PIN = 19;       // OUTPUT, green stack light
-      
+        static const int HOME_PIN = 2;          // INPUT, blue "home" button (INT4)
+        static const int GO_PIN = 18;           // INPUT, green "go" button (INT3)
+        static const int PAUSE_PIN = 19;        // INPUT, yellow "pause" button (INT2)
+
+        static const unsigned long DEBOUNCE_US = 20000; // A press needs the button quiet this long before it
+        static const uint8_t QUEUE_SIZE = 8;    // Presses waiting for the main loop (one slot stays empty)
+
+        volatile bool *pauseFlag;               // Reference to global pause flag
+
+        // Press queue. The button ISRs only advance "tail" and the main loop only advances "head"; the ISRs
+        // cannot interrupt each other, so between them they are a single producer.
+        Event queue[QUEUE_SIZE];
+        volatile uint8_t head;                  // Oldest press
+        volatile uint8_t tail;                  // Next free slot
+        volatile uint8_t dropped;               // Presses lost to a full queue (stops at 255)
+        unsigned long lastEdge[3];              // micros() at each button's last edge, either way (ISR only)
+        bool down[3];                           // Each button's level at its last edge; true = pressed (ISR only)
+        unsigned long worst;                    // Longest latency handled so far (us)
+
+        bool edge(uint8_t button, bool pressed); // Debounce an edge and queue a press; "pressed" is the pin now.
+                                                 // True if the edge was a press (queued or not)
 };
 #endif
@@ -1,41 +1,117 @@
 // Class to handle linear motor operations.
 //
+// Each cylinder runs a small state machine (RUNNING -> SETTLING -> DONE, or TIMED_OUT/PAUSED) that is
+// advanced once a millisecond by tick(), as an interrupt task of the sketch's scheduler. The tick stops a
+// cylinder when its microswitch closes, its time runs out or the pause flag is set, so the foreground
+// only has to start motions and, when it needs to, wait for them.
+//
+// Microswitches on external interrupt pins (3, 20 and 21) stop their cylinder from the interrupt the
+// moment they close, and are not polled. Pins 4 and 36 have no interrupt, so the tick polls them.
+//
 // Currently, all constants are stored internally in the class. If we start to hit memory issues we can
 // change these to preprocessor directives, but I want to hold off on that unless absolutely necessary.
 
 #include "Linear.h"
 
+// Bit for each motion: cylinder*2, plus 1 for a retract
+#define MOTION(cylinder, dir) (1 << (2*(cylinder) + (((dir) > 0) ? 0 : 1)))
+
+static const char DOOR_EXTEND_NAME[] PROGMEM = "Door extend";
+static const char DOOR_RETRACT_NAME[] PROGMEM = "Door retract";
+static const char IGNITOR_EXTEND_NAME[] PROGMEM = "Ignitor extend";
+static const char IGNITOR_RETRACT_NAME[] PROGMEM = "Ignitor retract";
+static const char ERECTOR_EXTEND_NAME[] PROGMEM = "Erector extend";
+static const char ERECTOR_RETRACT_NAME[] PROGMEM = "Erector retract";
+static const char *const MOTION_NAMES[6] PROGMEM = {DOOR_EXTEND_NAME, DOOR_RETRACT_NAME,
+    IGNITOR_EXTEND_NAME, IGNITOR_RETRACT_NAME, ERECTOR_EXTEND_NAME, ERECTOR_RETRACT_NAME};
+
+const uint8_t Linear::CONFLICTS[6] = {
+    MOTION(ERECTOR, EXTEND) | MOTION(ERECTOR, RETRACT),                                // Door extend
+    0,                                                                                 // Door retract
+    MOTION(ERECTOR, EXTEND) | MOTION(ERECTOR, RETRACT),                                // Ignitor extend
+    MOTION(ERECTOR, EXTEND) | MOTION(ERECTOR, RETRACT),                                // Ignitor retract
+    MOTION(DOOR, EXTEND) | MOTION(IGNITOR, EXTEND) | MOTION(IGNITOR, RETRACT),         // Erector extend
+    MOTION(DOOR, EXTEND) | MOTION(IGNITOR, EXTEND) | MOTION(IGNITOR, RETRACT),         // Erector retract
+};
+
 // Constructor: Set all relevant pins to "output" and provide default values
 Linear::Linear(volatile bool *pFlag){
     pauseFlag = pFlag; // This will refer to the global pause flag variable
-    pinMode(M_DOR_PIN,INPUT_PULLUP);
-    pinMode(M_ERC_OUT_PIN,INPUT_PULLUP);
-    pinMode(M_ERC_IN_PIN,INPUT_PULLUP);
-    pinMode(M_IGN_OUT_PIN,INPUT_PULLUP);
-    pinMode(M_IGN_IN_PIN,INPUT_PULLUP);
+    FastPin<M_DOR_PIN>::inputPullup();
+    FastPin<M_ERC_OUT_PIN>::inputPullup();
+    FastPin<M_ERC_IN_PIN>::inputPullup();
+    FastPin<M_IGN_OUT_PIN>::inputPullup();
+    FastPin<M_IGN_IN_PIN>::inputPullup();
 
     // these are the six outputs used to control the linear motors
     // these drive relays that enable the motors to run forward or reverse
-    pinMode(DOR_MIN_PIN,OUTPUT);
-    pinMode(DOR_PLS_PIN,OUTPUT);
-    pinMode(ERC_MIN_PIN,OUTPUT);
-    pinMode(ERC_PLS_PIN,OUTPUT);
-    pinMode(IGN_MIN_PIN,OUTPUT);
-    pinMode(IGN_PLS_PIN,OUTPUT);
+    RelayPins::output();
 
     // this sets the initial state of the digital outputs so that the relays are off at startup
+    // (all six relay pins are on port A, so this is a single write)
     // Karnaugh map:
     // MIN  PLS
     // 1    1   both relays are de-energized, relay PCB LEDs both OFF, normally open
     // 0    0   both relays are energized, relay PCB LEDs both ON, normally closed
     // 1    0   +12V to black wire on linear stage, GND to red wire
     // 0    1   +12V to red wire on linear stage, GND to black wire
-    digitalWrite(DOR_MIN_PIN,HIGH);
-    digitalWrite(DOR_PLS_PIN,HIGH);
-    digitalWrite(ERC_MIN_PIN,HIGH);
-    digitalWrite(ERC_PLS_PIN,HIGH);
-    digitalWrite(IGN_MIN_PIN,HIGH);
-    digitalWrite(IGN_PLS_PIN,HIGH);
+    RelayPins::high();
+
+    // Relays, microswitches and times for each cylinder
+    Cylinder &door = cylinders[DOOR];
+    door.plsPin = FastPin<DOR_PLS_PIN>::ref();
+    door.minPin = FastPin<DOR_MIN_PIN>::ref();
+    door.extSwitch = FastPin<M_DOR_PIN>::ref(); // Not used; the door has no "closed" microswitch
+    door.retSwitch = FastPin<M_DOR_PIN>::ref();
+    door.hasExtSwitch = false;
+    door.timeout = DOR_TIME;
+    door.settle = SETTLE_TIME;
+
+    Cylinder &ignitor = cylinders[IGNITOR];
+    ignitor.plsPin = FastPin<IGN_PLS_PIN>::ref();
+    ignitor.minPin = FastPin<IGN_MIN_PIN>::ref();
+    ignitor.extSwitch = FastPin<M_IGN_OUT_PIN>::ref();
+    ignitor.retSwitch = FastPin<M_IGN_IN_PIN>::ref();
+    ignitor.hasExtSwitch = true;
+    ignitor.timeout = IGN_TIME;
+    ignitor.settle = SETTLE_TIME;
+
+    Cylinder &erector = cylinders[ERECTOR];
+    erector.plsPin = FastPin<ERC_PLS_PIN>::ref();
+    erector.minPin = FastPin<ERC_MIN_PIN>::ref();
+    erector.extSwitch = FastPin<M_ERC_OUT_PIN>::ref();
+    erector.retSwitch = FastPin<M_ERC_IN_PIN>::ref();
+    erector.hasExtSwitch = true;
+    erector.timeout = ERC_TIME;
+    erector.settle = ERC_SETTLE_TIME;
+
+    for (int i = 0; i < 3; i++) {
+      cylinders[i].state = IDLE;
+      cylinders[i].dir = 0;
+      cylinders[i].elapsed = 0;
+      cylinders[i].limit = cylinders[i].timeout;
+      cylinders[i].extInterrupt = false;
+      cylinders[i].retInterrupt = false;
+      cylinders[i].timedOut = false;
+      cylinders[i].travelTime = 0;
+      cylinders[i].fullStroke = false;
+      cylinders[i].lastEnd = 0;
+      cylinders[i].learned = true;
+      cylinders[i].slow = false;
+    }
+
+    // Load the learned travel times; start from scratch if they were saved in another layout
+    if (EEPROM.read(EEPROM_LINEAR) == TRAVEL_VERSION) {
+      EEPROM.get(EEPROM_LINEAR + 1, travel);
+    }
+    else {
+      for (int i = 0; i < 6; i++) {
+        travel[i].mean = 0;
+        travel[i].longest = 0;
+        travel[i].strokes = 0;
+        travel[i].slowCount = 0;
+      }
+    }
 }
 
 
@@ -46,101 +122,234 @@ Linear::Linear(volatile bool *pFlag){
 // When you write a "member" function of a class you must preface it with "Classname::memberFunction()" as
 // you see here
 void Linear::reset(){
-    Serial.println("Relay conditions reset");
-    digitalWrite(DOR_MIN_PIN,HIGH);
-    digitalWrite(DOR_PLS_PIN,HIGH);
-    digitalWrite(ERC_MIN_PIN,HIGH);
-    digitalWrite(ERC_PLS_PIN,HIGH);
-    digitalWrite(IGN_MIN_PIN,HIGH);
-    digitalWrite(IGN_PLS_PIN,HIGH);
+    Serial.println(F("Relay conditions reset"));
+    uint8_t oldSREG = SREG;
+    cli();
+    RelayPins::high();
+    for (int i = 0; i < 3; i++) {cylinders[i].state = IDLE;}
+    SREG = oldSREG;
 }
+
 int Linear::doorExtend() {
-    
-    digitalWrite(DOR_PLS_PIN,LOW);
-    bool flag = true;
-    long timer = millis();
-    while(flag){
-      if(*pauseFlag){break;}
-      if((millis() - timer) > DOR_TIME) {break;}
-    }
-    digitalWrite(DOR_PLS_PIN,HIGH);
-    delay(100);
-    return 0;
+    return run(DOOR, EXTEND);
 }
 
 int Linear::doorRetract() {
-    if (!digitalRead(M_DOR_PIN) || (*pauseFlag)) {return 0;}
-    digitalWrite(DOR_MIN_PIN,LOW);
-    bool flag = true;
-    long timer = millis();
-    while(flag){
-      if(!digitalRead(M_DOR_PIN)) {break;}
-      if(*pauseFlag) {break;}
-      if((millis() - timer) > DOR_TIME) {break;}
-    }
-    digitalWrite(DOR_MIN_PIN,HIGH);
-    delay(100);
-    return 0;
+    return run(DOOR, RETRACT);
 }
 
 int Linear::erectExtend() {
-    if (!digitalRead(M_ERC_OUT_PIN) || (*pauseFlag)) {return 0;}
-    digitalWrite(ERC_PLS_PIN,LOW);
-    bool flag = true;
-    long timer = millis();
-    Serial.println (*pauseFlag);
-    while(flag){
-      if(!digitalRead(M_ERC_OUT_PIN)) {break;}
-      if(*pauseFlag){break;}
-      if((millis() - timer) > ERC_TIME) {break;}
-    }
-    digitalWrite(ERC_PLS_PIN,HIGH);
-    delay(1000);
-    return 0;
+    return run(ERECTOR, EXTEND);
 }
 
 int Linear::erectRetract() {
-    
-    if (!digitalRead(M_ERC_IN_PIN) || (*pauseFlag)) {return 0;}
-    digitalWrite(ERC_MIN_PIN,LOW);
-    bool flag = true;
-    long timer = millis();
-    while(flag){
-      if(!digitalRead(M_ERC_IN_PIN)) {break;}
-      if(*pauseFlag) {break;}
-      if((millis() - timer) > ERC_TIME) {break;}
-    }
-    digitalWrite(ERC_MIN_PIN,HIGH);
-    delay(1000);
-    return 0;
+    return run(ERECTOR, RETRACT);
 }
 
 int Linear::igniteExtend() {
-    if (!digitalRead(M_IGN_OUT_PIN) || (*pauseFlag)) {return 0;}
-    digitalWrite(IGN_PLS_PIN,LOW);
-    bool flag = true;
-    long timer = millis();
-    while(flag){
-      if(!digitalRead(M_IGN_OUT_PIN)){break;}
-      if(*pauseFlag){break;}
-      if((millis() - timer) > IGN_TIME) {break;}
-    }
-    digitalWrite(IGN_PLS_PIN,HIGH);
-    delay(100);
-    return 0;
+    return run(IGNITOR, EXTEND);
 }
 
 int Linear::igniteRetract() {
-    if (!digitalRead(M_IGN_IN_PIN) || (*pauseFlag)) {return 0;}
-    digitalWrite(IGN_MIN_PIN,LOW);
-    bool flag = true;
-    long timer = millis();
-    while(flag){
-      if(!digitalRead(M_IGN_IN_PIN)) {break;}
-      if(*pauseFlag) {break;}
-      if((millis() - timer) > IGN_TIME) {break;}
-    }
-    digitalWrite(IGN_MIN_PIN,HIGH);
-    delay(100);
-    return 0;
+    return run(IGNITOR, RETRACT);
+}
+
+int Linear::start(int cylinder, int dir) {
+    Cylinder &c = cylinders[cylinder];
+    if (busy(cylinder)) {return REFUSED;} // One motion at a time per cylinder
+    learn(cylinder); // Record the last motion if nobody waited for it
+
+    // Check the interlocks against everything that is running
+    uint8_t conflicts = CONFLICTS[2*cylinder + ((dir > 0) ? 0 : 1)];
+    for (int i = 0; i < 3; i++) {
+      if (busy(i) && (conflicts & (1 << (2*i + ((cylinders[i].dir > 0) ? 0 : 1))))) {return REFUSED;}
+    }
+
+    uint8_t oldSREG = SREG;
+    cli();
+    c.dir = dir;
+    c.elapsed = 0;
+    c.timedOut = false;
+    c.travelTime = 0;
+    c.limit = limitFor(cylinder, dir);
+    // A full stroke starts from the other end: known from the last motion, or from its microswitch
+    c.fullStroke = (c.lastEnd == -dir) || ((dir > 0) ? !c.retSwitch.read() : (c.hasExtSwitch && !c.extSwitch.read()));
+    c.lastEnd = 0; // Somewhere in between until this motion finishes
+    c.learned = false;
+    c.slow = false;
+    if (*pauseFlag || atEnd(c)) { // Nothing to do
+      c.state = *pauseFlag ? PAUSED : DONE;
+    }
+    else {
+      c.state = RUNNING;
+      if (dir > 0) {c.plsPin.low();}
+      else {c.minPin.low();}
+    }
+    SREG = oldSREG;
+    return c.state;
+}
+
+int Linear::poll(int cylinder) {
+    return cylinders[cylinder].state;
+}
+
+bool Linear::busy(int cylinder) {
+    uint8_t state = cylinders[cylinder].state;
+    return (state == RUNNING) || (state == SETTLING);
+}
+
+int Linear::wait(int cylinder) {
+    while (busy(cylinder)) {
+      yield(); // Let anything else that is waiting on us run
+    }
+    learn(cylinder);
+    return cylinders[cylinder].state;
+}
+
+bool Linear::slow(int cylinder) {
+    return cylinders[cylinder].slow;
+}
+
+uint8_t Linear::selfTest() {
+    // A cylinder with a switch at each end cannot have both closed at once; that is a short or a stuck
+    // switch, and a motion would stop on it straight away. Every relay pin should read back as driven.
+    uint8_t faults = 0;
+    for (int i = 0; i < 3; i++) {
+      Cylinder &c = cylinders[i];
+      bool bothEnds = c.hasExtSwitch && !c.extSwitch.read() && !c.retSwitch.read();
+      bool stuck = (c.plsPin.read() != c.plsPin.state()) || (c.minPin.read() != c.minPin.state());
+      if (bothEnds || stuck) {faults |= 1 << i;}
+    }
+    return faults;
+}
+
+void Linear::attachSwitches(void (*isr)(void)) {
+    const int switches[5] = {M_IGN_OUT_PIN, M_IGN_IN_PIN, M_ERC_OUT_PIN, M_ERC_IN_PIN, M_DOR_PIN};
+    bool *flags[5] = {&cylinders[IGNITOR].extInterrupt, &cylinders[IGNITOR].retInterrupt,
+        &cylinders[ERECTOR].extInterrupt, &cylinders[ERECTOR].retInterrupt, &cylinders[DOOR].retInterrupt};
+    for (int i = 0; i < 5; i++) {
+      int num = digitalPinToInterrupt(switches[i]);
+      if (num == NOT_AN_INTERRUPT) {continue;} // Stays polled
+      attachInterrupt(num, isr, FALLING);
+      *flags[i] = true;
+    }
+}
+
+void Linear::switchISR() {
+    // Any of the switches may have closed; stop every cylinder whose end of travel has been reached
+    for (int i = 0; i < 3; i++) {
+      Cylinder &c = cylinders[i];
+      if ((c.state == RUNNING) && atEnd(c)) {
+        c.travelTime = c.elapsed;
+        stop(c, SETTLING);
+      }
+    }
+}
+
+void Linear::pauseISR() {
+    // The tick would see the pause flag within a millisecond; this is the same stop without the wait
+    for (int i = 0; i < 3; i++) {
+      Cylinder &c = cylinders[i];
+      if (c.state == RUNNING) {stop(c, PAUSED);}
+    }
+}
+
+void Linear::tick() {
+    for (int i = 0; i < 3; i++) {
+      Cylinder &c = cylinders[i];
+      if (c.state == RUNNING) {
+        c.elapsed++;
+        if (*pauseFlag) {stop(c, PAUSED);}
+        else if (!((c.dir > 0) ? c.extInterrupt : c.retInterrupt) && atEnd(c)) {
+          c.travelTime = c.elapsed;
+          stop(c, SETTLING);
+        }
+        else if (c.elapsed > c.limit) {
+          // Running out of time is the normal end of an extend with no microswitch
+          c.timedOut = (c.dir < 0) || c.hasExtSwitch;
+          stop(c, SETTLING);
+        }
+      }
+      else if (c.state == SETTLING) {
+        c.elapsed++;
+        if (c.elapsed > c.settle) {c.state = c.timedOut ? TIMED_OUT : DONE;}
+      }
+    }
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ ******************************************************************************/
+int Linear::run(int cylinder, int dir) {
+    start(cylinder, dir);
+    return (wait(cylinder) == PAUSED) ? -1 : 0;
+}
+
+bool Linear::atEnd(const Cylinder &c) {
+    if (c.dir > 0) {return c.hasExtSwitch && !c.extSwitch.read();}
+    return !c.retSwitch.read();
+}
+
+unsigned long Linear::limitFor(int cylinder, int dir) {
+    const Cylinder &c = cylinders[cylinder];
+    int motion = 2*cylinder + ((dir > 0) ? 0 : 1);
+
+    if ((dir > 0) && !c.hasExtSwitch) {
+      // Open loop: run for as long as the stroke the other way takes, plus a margin
+      const Travel &t = travel[motion + 1];
+      if (t.strokes < MIN_STROKES) {return c.timeout;}
+      return min(c.timeout, (unsigned long)(t.mean) + t.mean/5 + OPEN_LOOP_MARGIN);
+    }
+
+    const Travel &t = travel[motion];
+    if (t.strokes < MIN_STROKES) {return c.timeout;}
+    return min(c.timeout, (unsigned long)(t.mean) + t.mean/2 + TIMEOUT_MARGIN);
+}
+
+void Linear::learn(int cylinder) {
+    Cylinder &c = cylinders[cylinder];
+    if (c.learned || busy(cylinder)) {return;}
+    c.learned = true;
+    if ((c.state != DONE) && (c.state != TIMED_OUT)) {return;} // Paused part way; nothing to learn
+
+    int motion = 2*cylinder + ((c.dir > 0) ? 0 : 1);
+    Travel &t = travel[motion];
+    bool onSwitch = (c.state == DONE) && ((c.dir < 0) || c.hasExtSwitch);
+    c.lastEnd = onSwitch ? c.dir : 0; // An open-loop extend may have stopped short; only a switch says where it is
+
+    if (c.state == TIMED_OUT) {
+      c.slow = true;
+      t.slowCount = min(t.slowCount + 1, 255);
+      Serial.print((const __FlashStringHelper *)pgm_read_ptr(&MOTION_NAMES[motion])); Serial.println(F(" timed out"));
+    }
+    else if (onSwitch && c.fullStroke) {
+      unsigned long time = c.travelTime;
+      // Abnormally slow: a quarter longer than usual
+      c.slow = (t.strokes >= MIN_STROKES) && (time > (unsigned long)(t.mean) + t.mean/4);
+      if (c.slow) {
+        t.slowCount = min(t.slowCount + 1, 255);
+        Serial.print((const __FlashStringHelper *)pgm_read_ptr(&MOTION_NAMES[motion])); Serial.print(F(" slow: "));
+        Serial.print(time); Serial.print(F(" ms, usually ")); Serial.println(t.mean);
+      }
+
+      // Rolling average over roughly the last four strokes
+      if (t.strokes == 0) {t.mean = time;}
+      else {t.mean = (uint16_t)(((unsigned long)(t.mean)*3 + time + 2)/4);}
+      t.longest = max(t.longest, (uint16_t)(min(time, 65535UL)));
+      t.strokes = min(t.strokes + 1, 255);
+    }
+    else {
+      return; // Open loop, or a partial stroke; nothing new to save
+    }
+
+    // Only changed bytes are written, so this costs a few milliseconds per motion at most
+    EEPROM.update(EEPROM_LINEAR, TRAVEL_VERSION);
+    EEPROM.put(EEPROM_LINEAR + 1, travel);
+}
+
+void Linear::stop(Cylinder &c, uint8_t state) {
+    c.plsPin.high();
+    c.minPin.high();
+    c.state = state;
+    c.elapsed = 0;
 }
@@ -2,6 +2,9 @@
 #define LINEAR_H
 
 #include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+#include <EEPROM.h>
+#include "FastPin.h"
+#include "EepromMap.h"
 
 class Linear {
 
@@ -13,6 +16,8 @@ class Linear {
         // (B) The "pause" button is pushed, sending the AGSE to its "pause" state. This condition is monitored
         // with the internal boolean value "pauseFlag."
         // Case (A) relates to a succesful function completion, return a "0." If Case (B) causes the pause, return a "-1."
+        //
+        // These block until the motion is over. To run motions side by side, use start() and wait() instead.
         
         void reset();         // resets all relay position
         int doorExtend();     // extend; closes the payload door
@@ -22,6 +27,27 @@ class Linear {
         int igniteExtend();   // extend; inserts ignitor into rocket
         int igniteRetract();  // retract; removes ignitor from rocket
 
+        // Non-blocking operations. Each cylinder runs its own state machine from tick(), so the door,
+        // erector and ignitor (and the SCARA arm) can all be moving at once.
+        static const int DOOR = 0;      // Cylinder numbers
+        static const int IGNITOR = 1;
+        static const int ERECTOR = 2;
+        static const int EXTEND = 1;    // Directions
+        static const int RETRACT = -1;
+
+        enum State {IDLE, RUNNING, SETTLING, DONE, TIMED_OUT, PAUSED, REFUSED};
+
+        int start(int cylinder, int dir);  // Begin a motion; returns its state (REFUSED if an interlock blocks it)
+        int poll(int cylinder);            // Current state of a cylinder
+        bool busy(int cylinder);           // True while a cylinder is running or settling
+        int wait(int cylinder);            // Block until a cylinder is finished; returns its final state
+        void tick();                       // Scheduler task, every ms in the tick interrupt
+        bool slow(int cylinder);           // True if the cylinder's last motion was abnormally slow
+        uint8_t selfTest();                // Boot check of the switches and relays; bit (1 << cylinder) set for each fault
+        void attachSwitches(void (*isr)(void)); // Have microswitches on interrupt pins call "isr" when they close
+        void switchISR();                  // Microswitch interrupt handler; only call from that ISR
+        void pauseISR();                   // Drop the relays of every running cylinder; call from the pause ISR
+
 
     private:
         // ADD ALL REQUIRED PINS AS CONST INTS
@@ -32,27 +58,84 @@ class Linear {
         // "ERC" = erector raise/lower cylinder
 
         volatile bool *pauseFlag;      // This connects to the global pause state of the AGSE.
-        const int M_DOR_PIN = 36;     // INPUT, door retracted microswitch
-        const int DOR_MIN_PIN = 23;   // OUTPUT, door closer cylinder minus (black)
-        const int DOR_PLS_PIN = 22;   // OUTPUT, door closer cylinder plus (red)
+        static const int M_DOR_PIN = 36;     // INPUT, door retracted microswitch
+        static const int DOR_MIN_PIN = 23;   // OUTPUT, door closer cylinder minus (black)
+        static const int DOR_PLS_PIN = 22;   // OUTPUT, door closer cylinder plus (red)
+
+        static const int M_IGN_OUT_PIN = 4;  // INPUT, ignitor retracted microswitch
+        static const int M_IGN_IN_PIN = 3;   // INPUT, ignitor inserted microswitch
+        static const int IGN_MIN_PIN = 26;   // OUTPUT, ignitor cylinder minus (black)
+        static const int IGN_PLS_PIN = 27;   // OUTPUT, ignitor cylinder plus (red)
 
-        const int M_IGN_OUT_PIN = 4;  // INPUT, ignitor retracted microswitch
-        const int M_IGN_IN_PIN = 3;   // INPUT, ignitor inserted microswitch
-        const int IGN_MIN_PIN = 26;   // OUTPUT, ignitor cylinder minus (black)
-        const int IGN_PLS_PIN = 27;   // OUTPUT, ignitor cylinder plus (red)
+        static const int M_ERC_OUT_PIN = 21; // INPUT, erector raised microswitch (near the pivot)
+        static const int M_ERC_IN_PIN = 20;  // INPUT, erector lowered microswitch (near the payload compartment/front of AGSE)
+        static const int ERC_MIN_PIN = 24;   // OUTPUT, erector cylinder minus (black)
+        static const int ERC_PLS_PIN = 25;   // OUTPUT, erector cylinder plus (red)
 
-        const int M_ERC_OUT_PIN = 21; // INPUT, erector raised microswitch (near the pivot)
-        const int M_ERC_IN_PIN = 20;  // INPUT, erector lowered microswitch (near the payload compartment/front of AGSE)
-        const int ERC_MIN_PIN = 24;   // OUTPUT, erector cylinder minus (black)
-        const int ERC_PLS_PIN = 25;   // OUTPUT, erector cylinder plus (red)
+        // All six relay pins, written together (they share port A)
+        typedef FastPins<DOR_MIN_PIN, DOR_PLS_PIN, IGN_MIN_PIN, IGN_PLS_PIN, ERC_MIN_PIN, ERC_PLS_PIN> RelayPins;
 
         // Hardcoded timer values
-        const unsigned long DOR_TIME = 7000;
-        const unsigned long IGN_TIME = 10000;
-        const unsigned long ERC_TIME = 10000;
+        static const unsigned long DOR_TIME = 7000;
+        static const unsigned long IGN_TIME = 10000;
+        static const unsigned long ERC_TIME = 10000;
+        static const unsigned long SETTLE_TIME = 100;   // Relays off before the next motion (ms)
+        static const unsigned long ERC_SETTLE_TIME = 1000; // The rail takes longer to come to rest (ms)
+
+        // Learned travel times. Every full stroke that ends on a microswitch is timed and folded into a
+        // rolling average kept in EEPROM. Once there are enough strokes, the timeout for that motion
+        // comes down to the average plus a margin, and the door's open-loop close (it has no "closed"
+        // microswitch) is cut to the time its opening stroke takes plus a margin. An opening stroke only
+        // counts as full if it starts on a switch, never straight after an open-loop close, which may
+        // have stopped short; otherwise a slow close would shorten itself a little more on every run.
+        static const uint8_t TRAVEL_VERSION = 1;    // Change when the Travel layout changes
+        static const uint8_t MIN_STROKES = 3;       // Strokes needed before learned times are used
+        static const unsigned long TIMEOUT_MARGIN = 500;   // Added to half again the average (ms)
+        static const unsigned long OPEN_LOOP_MARGIN = 250; // Added to a fifth again the average (ms)
+
+        struct Travel {
+            uint16_t mean;                  // Rolling average of full-stroke times (ms)
+            uint16_t longest;               // Longest full stroke seen (ms)
+            uint8_t strokes;                // Full strokes timed, up to 255
+            uint8_t slowCount;              // Strokes that were abnormally slow or timed out
+        };
+        Travel travel[6];                   // One per motion, numbered as for CONFLICTS
+
+        // Interlocks: motions that may not run at the same time as each other, as a bit mask of motion
+        // numbers (cylinder*2, plus 1 for a retract). The rail must not move while the door is still
+        // closing or while the ignitor is moving; the door may open again while the rail goes up.
+        static const uint8_t CONFLICTS[6];
 
+        // One linear cylinder and the motion it is running. Shared with tick().
+        struct Cylinder {
+            PinRef plsPin;                  // OUTPUT, relay driving the cylinder out
+            PinRef minPin;                  // OUTPUT, relay driving the cylinder in
+            PinRef extSwitch;               // INPUT, microswitch that ends an extend
+            PinRef retSwitch;               // INPUT, microswitch that ends a retract
+            bool hasExtSwitch;              // False if an extend only stops on its timeout
+            bool extInterrupt;              // The extend microswitch raises an interrupt (not polled)
+            bool retInterrupt;              // The retract microswitch raises an interrupt (not polled)
+            unsigned long timeout;          // Longest a motion may ever run (ms)
+            volatile unsigned long limit;   // Longest the current motion may run (ms)
+            unsigned long settle;           // Time to wait after the relays drop out (ms)
+            volatile uint8_t state;         // See State
+            volatile int8_t dir;            // Direction of the current motion
+            volatile unsigned long elapsed; // Time in the current state (ms)
+            volatile bool timedOut;         // The motion ran out of time before its microswitch closed
+            volatile unsigned long travelTime; // Time the current motion took to reach its microswitch (ms)
+            bool fullStroke;                // The motion started from the other end of travel
+            int8_t lastEnd;                 // End of travel the cylinder is known to be at (0 = unknown)
+            bool learned;                   // The result of the last motion has been recorded
+            bool slow;                      // The last motion was abnormally slow
+        };
+        Cylinder cylinders[3];
 
         // ALSO ADD ANY OTHER REQUIRED FUNCTIONS AS PRIVATE FUNCTIONS
+        int run(int cylinder, int dir);    // start() then wait()
+        bool atEnd(const Cylinder &c);     // True if the microswitch for the current motion is closed
+        void stop(Cylinder &c, uint8_t state); // Drop the relays and move to "state"
+        unsigned long limitFor(int cylinder, int dir); // Timeout for a motion, from the learned times
+        void learn(int cylinder);          // Record the result of a finished motion
 
 };
 #endif
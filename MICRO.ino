@@ -1,45 +0,0 @@
-//const int M_DOR_PIN = 36;
-//const int M_IGN_OUT_PIN = 2;
-//const int M_IGN_IN_PIN = 3;
-//const int M_ERC_OUT_PIN = 21;
-//const int M_ERC_IN_PIN = 20;
-//const int M_CTL_STP_PIN = 19;
-//const int M_CTL_GO_PIN = 18;
-//const int M_CTL_HOM_PIN = 39;
-//const int M_ROT_OUT_PIN = 30;
-//const int M_ROT_IN_PIN = 31;
-//const int M_LIN_UP_PIN = 33;
-//const int M_LIN_DWN_PIN = 32;
-//
-//void setup() {
-//  // put your setup code here, to run once:
-//Serial.begin(9600);
-//pinMode(M_DOR_PIN,INPUT_PULLUP);
-//pinMode(M_IGN_OUT_PIN, INPUT_PULLUP);
-//pinMode(M_IGN_IN_PIN, INPUT_PULLUP);
-//pinMode(M_ERC_OUT_PIN, INPUT_PULLUP);
-//pinMode(M_ERC_IN_PIN, INPUT_PULLUP);
-//pinMode(M_CTL_STP_PIN, INPUT_PULLUP);
-//pinMode(M_CTL_GO_PIN, INPUT_PULLUP);
-//pinMode(M_CTL_HOM_PIN, INPUT_PULLUP);
-//pinMode(M_ROT_OUT_PIN, INPUT_PULLUP);
-//pinMode(M_ROT_IN_PIN, INPUT_PULLUP);
-//pinMode(M_LIN_UP_PIN, INPUT_PULLUP);
-//pinMode(M_LIN_DWN_PIN, INPUT_PULLUP);
-//}
-//
-//void loop() {
-//  // put your main code here, to run repeatedly:
-//if(!digitalRead(M_DOR_PIN)){Serial.println("Door Micro");}
-//if(!digitalRead(M_IGN_OUT_PIN)){Serial.println("Ign Out Micro");}
-//if(!digitalRead(M_IGN_IN_PIN)){Serial.println("Ign In Micro");}
-//if(!digitalRead(M_ERC_OUT_PIN)){Serial.println("Erc Out Micro");}
-//if(!digitalRead(M_ERC_IN_PIN)){Serial.println("Erc In Micro");}
-//if(!digitalRead(M_CTL_GO_PIN)){Serial.println("Ctl Go Micro");}
-//if(!digitalRead(M_CTL_STP_PIN)){Serial.println("Ctl Pause Micro");}
-//if(!digitalRead(M_CTL_HOM_PIN)){Serial.println("Ctl Home Micro");}
-//if(!digitalRead(M_ROT_OUT_PIN)){Serial.println("Mot Out Micro");}
-//if(!digitalRead(M_ROT_IN_PIN)){Serial.println("Mot In Micro");}
-//if(!digitalRead(M_LIN_UP_PIN)){Serial.println("Mot Up Micro");}
-//if(!digitalRead(M_LIN_DWN_PIN)){Serial.println("Mot Down Micro");}
-//}
@@ -0,0 +1,265 @@
+// Microswitch and button bounce logger. A diagnostic sketch of its own: flash it instead of AGSE-stable
+// (open this folder in the IDE, not the main one), open the serial monitor at 115200 and work each
+// switch by hand or let the rig run it.
+//
+// Timer2 samples every switch and button pin 20,000 times a second. The pins sit on four ports, so a
+// sample is four port reads; a change on any watched bit goes into a ring buffer with the sample count,
+// so edges are timed to 50 us and none are lost while the serial port is busy. The main loop sorts the
+// edges into bursts, one per input: a burst starts with an edge after the input has been quiet for
+// QUIET_MS and ends once it has been quiet that long again. A burst that leaves the input at the other
+// level is a press or release (its length is the bounce); one that leaves it where it was is a glitch
+// (noise or a knock, not a real change).
+//
+// Each burst is printed as it ends. Send any character for a summary per input: presses and releases,
+// mean and longest bounce, most edges in one burst and glitches. The longest bounce is what a debounce
+// window such as Input::DEBOUNCE_US has to cover.
+
+/*******************************************************************************
+ * OPERATION CONSTANTS
+ ******************************************************************************/
+ const unsigned int SAMPLE_US = 50;          // Sample period (Timer2, 16 MHz/8, 100 counts)
+ const unsigned long QUIET_MS = 50;          // Quiet time that ends a burst
+ const unsigned long QUIET_SAMPLES = QUIET_MS*1000/SAMPLE_US;
+ const int RING_SIZE = 256;                  // Edges buffered between drains (power of 2)
+ const int PORTS = 4;                        // C, D, E and G, in that order
+
+ // The inputs, as wired to the AGSE firmware (pin numbers from Scara.h, Linear.h and Input.h)
+ struct Switch {
+   const char *name;                         // PROGMEM
+   uint8_t pin;                              // Arduino Mega pin
+   uint8_t port;                             // Index into the sampled ports
+   uint8_t mask;                             // Bit within that port
+ };
+ const char ROT_PLS_NAME[] PROGMEM = "rot plus (home)";
+ const char ROT_MIN_NAME[] PROGMEM = "rot minus";
+ const char LIN_PLS_NAME[] PROGMEM = "lin plus";
+ const char LIN_MIN_NAME[] PROGMEM = "lin minus (home)";
+ const char DOOR_NAME[] PROGMEM = "door retracted";
+ const char IGN_OUT_NAME[] PROGMEM = "ignitor out";
+ const char IGN_IN_NAME[] PROGMEM = "ignitor in";
+ const char ERC_OUT_NAME[] PROGMEM = "erector raised";
+ const char ERC_IN_NAME[] PROGMEM = "erector lowered";
+ const char HOME_NAME[] PROGMEM = "HOME button";
+ const char GO_NAME[] PROGMEM = "GO button";
+ const char PAUSE_NAME[] PROGMEM = "PAUSE button";
+ const Switch SWITCHES[] PROGMEM = {
+   {ROT_PLS_NAME, 30, 0, 1 << 7}, {ROT_MIN_NAME, 31, 0, 1 << 6},
+   {LIN_PLS_NAME, 33, 0, 1 << 4}, {LIN_MIN_NAME, 32, 0, 1 << 5},
+   {DOOR_NAME, 36, 0, 1 << 1},
+   {IGN_OUT_NAME, 4, 3, 1 << 5}, {IGN_IN_NAME, 3, 2, 1 << 5},
+   {ERC_OUT_NAME, 21, 1, 1 << 0}, {ERC_IN_NAME, 20, 1, 1 << 1},
+   {HOME_NAME, 2, 2, 1 << 4}, {GO_NAME, 18, 1, 1 << 3}, {PAUSE_NAME, 19, 1, 1 << 2}};
+ const int INPUTS = sizeof(SWITCHES)/sizeof(SWITCHES[0]);
+
+/*******************************************************************************
+ * STATE
+ ******************************************************************************/
+// Edge ring, filled by the sample ISR and drained by the main loop
+struct Edge {
+  unsigned long sample;                     // Sample count when the change was seen
+  uint8_t port;                             // Index into the sampled ports
+  uint8_t changed;                          // Watched bits that changed
+};
+Edge ring[RING_SIZE];
+volatile uint8_t head = 0;                  // Oldest edge (main loop only)
+volatile uint8_t tail = 0;                  // Next free slot (ISR only)
+volatile unsigned int overflows = 0;        // Edges lost to a full ring
+volatile unsigned long samples = 0;         // Samples taken
+uint8_t watched[PORTS];                     // Bits of each port that are inputs above
+uint8_t last[PORTS];                        // Each port as last sampled (ISR only)
+
+// Per input: the burst in progress and the totals so far
+struct Stats {
+  uint8_t level;                            // Level once settled (LOW = closed)
+  bool bursting;                            // Edges seen and not yet quiet for QUIET_MS
+  uint8_t before;                           // Settled level the burst started from
+  unsigned long first;                      // Sample of its first edge
+  unsigned long latest;                     // Sample of its last edge
+  unsigned int edges;                       // Edges in it
+  unsigned int changes;                     // Bursts that were a press or a release
+  unsigned int glitches;                    // Bursts that came back to where they started
+  unsigned long bounceTotal;                // Sum of the changes' bounce (samples)
+  unsigned long longest;                    // Longest bounce (samples)
+  unsigned int mostEdges;                   // Most edges in one burst
+};
+Stats stats[INPUTS];
+
+/*******************************************************************************
+ * SETUP
+ ******************************************************************************/
+void setup() {
+  Serial.begin(115200);
+  for (int i = 0; i < INPUTS; i++) {
+    pinMode(pgm_read_byte(&SWITCHES[i].pin), INPUT_PULLUP);
+    watched[pgm_read_byte(&SWITCHES[i].port)] |= pgm_read_byte(&SWITCHES[i].mask);
+  }
+  delay(10); // Let the pull-ups charge the wiring
+
+  readPorts(last);
+  for (int i = 0; i < INPUTS; i++) {
+    Stats &s = stats[i];
+    s.level = (last[pgm_read_byte(&SWITCHES[i].port)] & pgm_read_byte(&SWITCHES[i].mask)) ? HIGH : LOW;
+    s.bursting = false;
+    s.changes = 0;
+    s.glitches = 0;
+    s.bounceTotal = 0;
+    s.longest = 0;
+    s.mostEdges = 0;
+  }
+  timerInit();
+
+  Serial.print(F("Bounce logger: ")); Serial.print(INPUTS); Serial.print(F(" inputs every "));
+  Serial.print(SAMPLE_US); Serial.print(F(" us, bursts end after ")); Serial.print(QUIET_MS);
+  Serial.println(F(" ms quiet. Send any character for a summary."));
+  for (int i = 0; i < INPUTS; i++) {
+    if (stats[i].level == LOW) {printName(i); Serial.println(F(" is closed"));}
+  }
+}
+
+/*******************************************************************************
+ * PROGRAM LOOP
+ ******************************************************************************/
+void loop() {
+  // Sort the new edges into bursts
+  while (head != tail) {
+    Edge e = ring[head];
+    head = (head + 1) % RING_SIZE;
+    for (int i = 0; i < INPUTS; i++) {
+      if ((pgm_read_byte(&SWITCHES[i].port) == e.port) && (e.changed & pgm_read_byte(&SWITCHES[i].mask))) {
+        edge(i, e.sample);
+      }
+    }
+  }
+
+  // Close the bursts that have gone quiet
+  uint8_t oldSREG = SREG; cli();
+  unsigned long now = samples;
+  uint8_t ports[PORTS];
+  for (int p = 0; p < PORTS; p++) {ports[p] = last[p];}
+  SREG = oldSREG;
+  for (int i = 0; i < INPUTS; i++) {
+    Stats &s = stats[i];
+    if (!s.bursting || (now - s.latest < QUIET_SAMPLES)) {continue;}
+    s.level = (ports[pgm_read_byte(&SWITCHES[i].port)] & pgm_read_byte(&SWITCHES[i].mask)) ? HIGH : LOW;
+    endBurst(i);
+  }
+
+  if (overflows > 0) {
+    oldSREG = SREG; cli();
+    unsigned int lost = overflows;
+    overflows = 0;
+    SREG = oldSREG;
+    Serial.print(F("Ring full, ")); Serial.print(lost); Serial.println(F(" edges lost"));
+  }
+
+  if (Serial.available() > 0) {
+    while (Serial.available() > 0) {Serial.read();}
+    summary();
+  }
+}
+
+void edge(int i, unsigned long sample) {
+  // One edge on input i
+  Stats &s = stats[i];
+  if (!s.bursting) {
+    s.bursting = true;
+    s.before = s.level;
+    s.first = sample;
+    s.edges = 0;
+  }
+  s.latest = sample;
+  s.edges++;
+}
+
+void endBurst(int i) {
+  // Input i has been quiet for QUIET_MS; s.level is where it settled
+  Stats &s = stats[i];
+  s.bursting = false;
+  unsigned long bounce = s.latest - s.first;
+  s.mostEdges = max(s.mostEdges, s.edges);
+
+  printName(i);
+  if (s.level == s.before) {
+    s.glitches++;
+    Serial.print(F(" glitch: "));
+  }
+  else {
+    s.changes++;
+    s.bounceTotal += bounce;
+    s.longest = max(s.longest, bounce);
+    Serial.print((s.level == LOW) ? F(" closed: ") : F(" opened: "));
+  }
+  Serial.print(s.edges); Serial.print(F(" edges over ")); printUs(bounce*SAMPLE_US);
+  Serial.println(F(" ms"));
+}
+
+void summary() {
+  Serial.println(F("Input: changes, mean/longest bounce (ms), most edges, glitches"));
+  for (int i = 0; i < INPUTS; i++) {
+    Stats &s = stats[i];
+    Serial.print(F("  ")); printName(i);
+    Serial.print(F(": ")); Serial.print(s.changes);
+    Serial.print(F(", ")); printUs((s.changes > 0) ? s.bounceTotal*SAMPLE_US/s.changes : 0);
+    Serial.print('/'); printUs(s.longest*SAMPLE_US);
+    Serial.print(F(", ")); Serial.print(s.mostEdges);
+    Serial.print(F(", ")); Serial.println(s.glitches);
+  }
+}
+
+void printName(int i) {
+  Serial.print((const __FlashStringHelper *)pgm_read_ptr(&SWITCHES[i].name));
+}
+
+void printUs(unsigned long us) {
+  // As ms, with two decimals
+  Serial.print(us/1000);
+  Serial.print('.');
+  unsigned int hundredths = (us % 1000)/10;
+  if (hundredths < 10) {Serial.print('0');}
+  Serial.print(hundredths);
+}
+
+/*******************************************************************************
+ * INTERRUPT HANDLING
+ ******************************************************************************/
+
+// TIMER INITIALIZATION
+void timerInit() {
+  // Timer2 is the sample clock: CTC, 16 MHz/8, 100 counts = 50 us
+    noInterrupts();
+    TCCR2A = (1 << WGM21);    // CTC mode
+    TCCR2B = (1 << CS21);     // 8 prescaler
+    TCNT2  = 0;
+    OCR2A = 99;               // compare match register 16MHz/8/20kHz
+    TIMSK2 |= (1 << OCIE2A);  // enable timer compare interrupt
+    interrupts();
+}
+
+void readPorts(uint8_t *ports) {
+  ports[0] = PINC;
+  ports[1] = PIND;
+  ports[2] = PINE;
+  ports[3] = PING;
+}
+
+// Sample every input; log the ports that changed
+ISR(TIMER2_COMPA_vect) {
+  uint8_t now[PORTS];
+  readPorts(now);
+  samples++;
+  for (uint8_t p = 0; p < PORTS; p++) {
+    uint8_t changed = (now[p] ^ last[p]) & watched[p];
+    if (changed == 0) {continue;}
+    last[p] = now[p];
+    uint8_t next = (tail + 1) % RING_SIZE;
+    if (next == head) { // Full; the main loop reports it
+      if (overflows < 65535) {overflows++;}
+      continue;
+    }
+    Edge &e = ring[tail];
+    e.sample = samples;
+    e.port = p;
+    e.changed = changed;
+    tail = next;
+  }
+}
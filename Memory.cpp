@@ -0,0 +1,72 @@
+// SRAM use and stack headroom; see Memory.h. The addresses come from symbols the avr-libc linker
+// script defines, so there is nothing to set up by hand.
+
+#include "Memory.h"
+
+#ifdef __AVR__
+extern uint8_t __data_start;    // First byte of the globals
+extern uint8_t __heap_start;    // First byte after them
+extern char *__brkval;          // Top of the heap, or 0 if nothing has been allocated
+
+static const uint8_t PAINT = 0xC5; // Fill byte; unlikely as a return address or saved register
+
+// The startup code runs straight through .init3 once the stack pointer is set, before the globals are
+// initialised or any constructor runs, so nothing above the globals is in use yet. Naked and never
+// called, so it has no frame of its own to paint over.
+void paintStack() __attribute__((naked, used, section(".init3")));
+void paintStack() {
+    for (uint8_t *p = &__heap_start; p <= (uint8_t *)RAMEND; p++) {*p = PAINT;}
+}
+
+static uint8_t *heapTop() {
+    return (__brkval != 0) ? (uint8_t *)__brkval : &__heap_start;
+}
+#endif
+
+// Constructor: Provide default values
+Memory::Memory() {
+    objects = 0;
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ ******************************************************************************/
+void Memory::object(const __FlashStringHelper *name, size_t size) {
+    objects += size;
+    Serial.print(F("  ")); Serial.print(name);
+    Serial.print(F(": ")); Serial.println(size);
+}
+
+unsigned int Memory::headroom() {
+#ifdef __AVR__
+    const uint8_t *p = heapTop();
+    unsigned int unused = 0;
+    while ((p + unused <= (const uint8_t *)RAMEND) && (p[unused] == PAINT)) {unused++;}
+    return unused;
+#else
+    return 0;
+#endif
+}
+
+unsigned int Memory::available() {
+#ifdef __AVR__
+    uint8_t top; // On the stack, so its address is about where the stack pointer is
+    return &top - heapTop();
+#else
+    return 0;
+#endif
+}
+
+void Memory::report() {
+#ifdef __AVR__
+    Serial.print(F("SRAM: ")); Serial.print(&__heap_start - &__data_start);
+    Serial.print(F(" of ")); Serial.print(RAMEND + 1 - (unsigned int)&__data_start);
+    Serial.print(F(" bytes in globals (")); Serial.print(objects);
+    Serial.print(F(" in the objects above), ")); Serial.print(available());
+    Serial.print(F(" free now, ")); Serial.print(headroom());
+    Serial.println(F(" never reached by the stack"));
+#else
+    Serial.print(F("SRAM: ")); Serial.print(objects);
+    Serial.println(F(" bytes in the objects above; stack not measured off the board"));
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+
+// SRAM use, for the serial log. The ATmega2560 has 8 KB: the globals (.data and .bss) at the bottom,
+// then the heap (nothing in the firmware allocates, so it stays empty) and the stack growing down from
+// the top. At reset, before any constructor runs, everything above the globals is painted with a fill
+// byte; the stack overwrites the paint as it grows, so the paint left over is the least free RAM
+// there has been since reset. That is the number to watch when a buffer or queue gets bigger.
+//
+// object() prints the size of one global object (a build-time constant) and keeps a running total, so
+// the sketch can list what each subsystem costs. Off the board there is no stack to paint, and
+// report() says so.
+class Memory {
+
+    public:
+        Memory(); // Constructor
+        void object(const __FlashStringHelper *name, size_t size); // Print the size of one object
+        void report();                      // Print the globals, the free RAM and the stack headroom
+        unsigned int headroom();            // Bytes the stack has never reached since reset
+        unsigned int available();           // Bytes between the globals and the stack right now
+
+    private:
+        size_t objects;                     // Total of the sizes given to object()
+};
+
+#endif
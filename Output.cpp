@@ -1,34 +1,66 @@
 // Class to handle AGSE outputs: Light tower/horn and LCD screen.
 //
+// The LCD is written through a frame buffer. Sending a character through the 4-bit interface takes
+// tens of microseconds and the LiquidCrystal library waits out each one, so redrawing a line used to
+// hold up the main loop for milliseconds. Now the print functions only update the buffer, and flush(),
+// a scheduler task that runs every ms, sends one byte each time (a character, or a cursor move before a
+// cell that is not next in line); the LCD is done with each byte long before the next one comes. A full
+// redraw takes about 34 ms.
+//
+// The light tower, horn and onboard LED are run the same way: setLight(), hornBlast() and friends start
+// a pattern from the tables below and return, and tick(), in the 1 ms tick interrupt, switches the
+// outputs as each step runs out. Between steps it only counts down.
+//
 // Currently, all constants are stored internally in the class. If we start to hit memory issues we can
 // change these to preprocessor directives, but I want to hold off on that unless absolutely necessary.
 
 #include "Output.h"
 #include <LiquidCrystal.h>
 
+// Patterns (see Output::Step)
+static const Output::Step BLINK_RED[] PROGMEM = {{Output::RED, 1000}, {0, 1000}, {Output::REPEAT, 0}};
+static const Output::Step BLINK_YELLOW[] PROGMEM = {{Output::YELLOW, 1000}, {0, 1000}, {Output::REPEAT, 0}};
+static const Output::Step BLINK_GREEN[] PROGMEM = {{Output::GREEN, 1000}, {0, 1000}, {Output::REPEAT, 0}};
+static const Output::Step HEARTBEAT[] PROGMEM = {{Output::LED, 1000}, {0, 1000}, {Output::REPEAT, 0}};
+static const Output::Step SHUFFLE[] PROGMEM = {
+    {Output::GREEN, 2000}, {Output::GREEN | Output::RED, 2000}, {Output::RED, 2000},
+    {Output::RED | Output::YELLOW, 2000}, {Output::YELLOW, 2000}, {Output::YELLOW | Output::GREEN, 2000},
+    {Output::RED | Output::YELLOW | Output::GREEN, 2000}, {0, 0}};
+static const Output::Step BLAST[] PROGMEM = {{Output::HORN, 1}, {0, 0}}; // hornBlast() sets the length
+static const Output::Step CHIRP[] PROGMEM = {
+    {Output::HORN, 100}, {0, 150}, {Output::HORN, 100}, {0, 150}, {Output::HORN, 100}, {0, 0}};
+
 // Constructor: Set all relevant pins to "output" and provide default values
 Output::Output(){
-    pinMode(GRN_PIN, OUTPUT);
-    pinMode(YLW_PIN, OUTPUT);
-    pinMode(RED_PIN, OUTPUT);
-    pinMode(HRN_PIN, OUTPUT);
-    pinMode(LED_MEGA_ONBOARD, OUTPUT);
+    // red/yellow share port J and green/horn share port H, so each pair is set with one write
+    FastPins<RED_PIN, YLW_PIN>::output();
+    FastPins<GRN_PIN, HRN_PIN>::output();
+    FastPin<LED_MEGA_ONBOARD>::output();
 
     // relays are energized when outputs of Arduino are LOW
     // LED of relay PCBA will turn on when pins are pulled LOW
-    digitalWrite(GRN_PIN, HIGH);
-    digitalWrite(RED_PIN, HIGH);
-    digitalWrite(YLW_PIN, HIGH);
-    digitalWrite(HRN_PIN, HIGH);
+    FastPins<RED_PIN, YLW_PIN>::high();
+    FastPins<GRN_PIN, HRN_PIN>::high();
 
     // initialize the library with the numbers of the interface pins
     // (note that the below function takes care of pinmode for all relevant pins for you)
-    lcd = new LiquidCrystal(LCD_RS,LCD_EN,LCD_D4,LCD_D5,LCD_D6,LCD_D7); // OUTPUT, LCD 4-bit data
+    // Only needed to bring the LCD up; send() drives the pins after that, so it does not outlive this
+    LiquidCrystal lcd(LCD_RS,LCD_EN,LCD_D4,LCD_D5,LCD_D6,LCD_D7); // OUTPUT, LCD 4-bit data
 
     // LCD setup
-    lcd -> begin(LCD_columns, LCD_rows); // declares the size of the LCD we're using (columns by rows)
+    lcd.begin(LCD_columns, LCD_rows); // declares the size of the LCD we're using (columns by rows)
     // printMessage("", "");
 
+    lights.first = NULL; lights.on = 0;
+    horn.first = NULL; horn.on = 0;
+    heartbeat.first = NULL; heartbeat.on = 0;
+    play(heartbeat, HEARTBEAT);
+
+    // begin() clears the LCD
+    for (int i = 0; i < CELLS; i++) {frame[i] = ' '; shown[i] = ' ';}
+    dirty = 0;
+    cursor = CELLS;
+
 
 }
 
@@ -40,15 +72,15 @@ Output::Output(){
 // When you write a "member" function of a class you must preface it with "Classname::memberFunction()" as
 // you see here
 void Output::redOn() {
-    digitalWrite(RED_PIN, LOW);
+    FastPin<RED_PIN>::low();
 }
 
 void Output::redOff() {
-    digitalWrite(RED_PIN, HIGH);
+    FastPin<RED_PIN>::high();
 }
 
 void Output::redToggle() {
-    if (digitalRead(RED_PIN)) { // If light is OFF
+    if (FastPin<RED_PIN>::read()) { // If light is OFF
       redOn();
     }
     else {
@@ -58,15 +90,15 @@ void Output::redToggle() {
 }
 
 void Output::greenOn() {
-    digitalWrite(GRN_PIN, LOW);
+    FastPin<GRN_PIN>::low();
 }
 
 void Output::greenOff() {
-    digitalWrite(GRN_PIN, HIGH);
+    FastPin<GRN_PIN>::high();
 }
 
 void Output::greenToggle() {
-    if (digitalRead(GRN_PIN)) { // If light is OFF
+    if (FastPin<GRN_PIN>::read()) { // If light is OFF
       greenOn();
     }
     else {
@@ -75,15 +107,15 @@ void Output::greenToggle() {
 }
 
 void Output::yellowOn() {
-    digitalWrite(YLW_PIN, LOW);
+    FastPin<YLW_PIN>::low();
 }
 
 void Output::yellowOff() {
-    digitalWrite(YLW_PIN, HIGH);
+    FastPin<YLW_PIN>::high();
 }
 
 void Output::yellowToggle() {
-    if (digitalRead(YLW_PIN)) { // If light is OFF
+    if (FastPin<YLW_PIN>::read()) { // If light is OFF
       yellowOn();
     }
     else {
@@ -91,15 +123,15 @@ void Output::yellowToggle() {
     }
 }
 void Output::ledOn() {
-    digitalWrite(LED_MEGA_ONBOARD, HIGH);
+    FastPin<LED_MEGA_ONBOARD>::high();
 }
 
 void Output::ledOff() {
-    digitalWrite(LED_MEGA_ONBOARD, LOW);
+    FastPin<LED_MEGA_ONBOARD>::low();
 }
 
 void Output::ledToggle(){
-if (!digitalRead(LED_MEGA_ONBOARD)) { // If light is OFF
+if (!FastPin<LED_MEGA_ONBOARD>::read()) { // If light is OFF
      ledOn();
     }
     else {
@@ -108,91 +140,199 @@ if (!digitalRead(LED_MEGA_ONBOARD)) { // If light is OFF
 }
 
 void Output::setLight(int light){
-  // Turn off the currently blinking light, in case it's on
-  if (currentLight != 0) {
-    digitalWrite(currentLight, HIGH);
-  }
+  // Whatever was blinking goes off
   switch (light) {
-    case (0): {currentLight = 0; break;}       // None
-    case (1): {currentLight = RED_PIN; break;} // Red
-    case (2): {currentLight = YLW_PIN; break;} // Yellow
-    case (3): {currentLight = GRN_PIN; break;} // Green
+    case (0): {play(lights, NULL); break;}          // None
+    case (1): {play(lights, BLINK_RED); break;}     // Red
+    case (2): {play(lights, BLINK_YELLOW); break;}  // Yellow
+    case (3): {play(lights, BLINK_GREEN); break;}   // Green
     default: {break;}
     }
   }
-  
 
-void Output::toggle() { // Toggle current light setting
-  if (currentLight == 0) {return;}
-  digitalWrite(currentLight, !digitalRead(currentLight));
+void Output::randomLight()  {
+  play(lights, SHUFFLE);
 }
 
-void Output::randomLight()  {
-  int number=random(6);
-  while(number==0){
-    greenOn();
-    delay(1000);
-    number=random(6);
-    delay(1000);
-  }
-  while(number==1){
-    greenOff();
-    delay(1000);
-    number=random(6);
-    delay(1000);
-  }
-  while(number==2){
-    yellowOn();
-    delay(1000);
-    number=random(6);
-    delay(1000);
+void Output::hornBlast(int duration) {
+  if (duration <= 0) {return;}
+  uint8_t oldSREG = SREG; cli();
+  play(horn, BLAST);
+  horn.left = duration;
+  SREG = oldSREG;
+}
+
+void Output::hornChirp() {
+  play(horn, CHIRP);
+}
+
+void Output::printTop(const char *message) {
+  setRow(0, message, false);
+}
+
+void Output::printBottom(const char *message) {
+  setRow(1, message, false);
+}
+
+void Output::printTop(const __FlashStringHelper *message) {
+  setRow(0, (const char *)message, true);
+}
+
+void Output::printBottom(const __FlashStringHelper *message) {
+  setRow(1, (const char *)message, true);
+}
+
+void Output::printMessage(const char *topMessage, const char *bottomMessage){
+  setRow(0, topMessage, false);
+  setRow(1, bottomMessage, false);
+}
+
+void Output::printMessage(const __FlashStringHelper *topMessage, const __FlashStringHelper *bottomMessage){
+  setRow(0, (const char *)topMessage, true);
+  setRow(1, (const char *)bottomMessage, true);
+}
+
+void Output::tick() {
+  advance(lights);
+  advance(horn);
+  advance(heartbeat);
+}
+
+void Output::flush() {
+  uint32_t pending = dirty;
+  while (pending != 0) {
+    // Carry on where the LCD's cursor is if that cell needs it, so a run of changes needs one cursor move
+    uint8_t cell = cursor;
+    if ((cell >= CELLS) || !(pending & ((uint32_t)1 << cell))) {
+      cell = 0;
+      while (!(pending & ((uint32_t)1 << cell))) {cell++;}
+    }
+    char c = frame[cell];
+    if (c == shown[cell]) { // Changed back before it was sent
+      pending &= ~((uint32_t)1 << cell);
+      dirty = pending;
+      continue;
+    }
+    if (cell != cursor) { // Move the cursor this time, send the character on the next call
+      send(0x80 | ((cell >= LCD_columns) ? 0x40 : 0) | (cell % LCD_columns), false);
+      cursor = cell;
+      return;
+    }
+    dirty = pending & ~((uint32_t)1 << cell);
+    send(c, true);
+    shown[cell] = c;
+    cursor = ((cell % LCD_columns) == LCD_columns - 1) ? CELLS : cell + 1; // The LCD runs on past the end of a row
+    return;
   }
-  while(number==3){
-    yellowOff();
-    delay(1000);
-    number=random(6);
-    delay(1000);
+}
+
+bool Output::drawn() {
+  return dirty == 0;
+}
+
+uint8_t Output::selfTest() {
+  // A shorted output reads back at the wrong level. The lamps, the horn and the LCD itself cannot be
+  // read (the LCD's R/W line is tied low), so those are for the operator to look at. The tick switches
+  // the LED and the lights, so they are read back with it held off.
+  uint8_t faults = 0;
+  uint8_t oldSREG = SREG; cli();
+  if (FastPin<RED_PIN>::stuck()) {faults |= RED;}
+  if (FastPin<YLW_PIN>::stuck()) {faults |= YELLOW;}
+  if (FastPin<GRN_PIN>::stuck()) {faults |= GREEN;}
+  if (FastPin<HRN_PIN>::stuck()) {faults |= HORN;}
+  if (FastPin<LED_MEGA_ONBOARD>::stuck()) {faults |= LED;}
+  if (FastPin<LCD_RS>::stuck() || FastPin<LCD_EN>::stuck() || FastPin<LCD_D4>::stuck() ||
+      FastPin<LCD_D5>::stuck() || FastPin<LCD_D6>::stuck() || FastPin<LCD_D7>::stuck()) {
+    faults |= LCD;
   }
-  while(number==4){
-    redOn();
-    delay(1000);
-    number=random(6);
-    delay(1000);
+  SREG = oldSREG;
+  return faults;
+}
+
+/*******************************************************************************
+ * PRIVATE FUNCTIONS
+ ******************************************************************************/
+void Output::play(Track &track, const Step *pattern) {
+  uint8_t oldSREG = SREG; cli();
+  track.first = pattern;
+  if (pattern == NULL) {
+    show(track, 0);
   }
-  while(number==5){
-    redOff();
-    delay(1000);
-    number=random(6);
-    delay(1000);
+  else {
+    track.step = pattern;
+    track.left = pgm_read_word(&pattern->ms);
+    show(track, pgm_read_byte(&pattern->outputs));
   }
+  SREG = oldSREG;
 }
 
-void Output::hornBlast(int duration) {
-    digitalWrite(HRN_PIN, LOW);
-    delay(duration);
-    digitalWrite(HRN_PIN, HIGH);
+void Output::advance(Track &track) {
+  if ((track.first == NULL) || (--track.left != 0)) {return;}
+  track.step++;
+  uint8_t outputs = pgm_read_byte(&track.step->outputs);
+  uint16_t ms = pgm_read_word(&track.step->ms);
+  if (ms == 0) { // End of the pattern
+    if (!(outputs & REPEAT)) {
+      show(track, 0);
+      track.first = NULL;
+      return;
+    }
+    track.step = track.first;
+    outputs = pgm_read_byte(&track.step->outputs);
+    ms = pgm_read_word(&track.step->ms);
+  }
+  show(track, outputs);
+  track.left = ms;
 }
 
-void Output::printTop(const char *message) {  
-  lcd -> setCursor(0, 0);
-  lcd -> print("                "); // Print 16 char to clear line
-  lcd -> setCursor(0, 0);
-  lcd -> print(message);
-}  
-
-void Output::printBottom(const char *message) {  
-  lcd -> setCursor(0, 1);
-  lcd -> print("                "); // Print 16 char to clear line
-  lcd -> setCursor(0, 1);
-  lcd -> print(message);
+void Output::show(Track &track, uint8_t outputs) {
+  drive(track.on & ~outputs, false);
+  drive(outputs & ~track.on, true);
+  track.on = outputs;
 }
 
-void Output::printMessage(const char *topMessage, const char *bottomMessage){
-  lcd -> clear();
-  lcd -> setCursor(0, 0);
-  lcd -> print(topMessage);
-  lcd -> setCursor(0, 1);
-  lcd -> print(bottomMessage);
+void Output::drive(uint8_t outputs, bool on) {
+  // The relays are energized when their pins are LOW; the onboard LED lights when its pin is HIGH
+  if (outputs & RED) {FastPin<RED_PIN>::write(!on);}
+  if (outputs & YELLOW) {FastPin<YLW_PIN>::write(!on);}
+  if (outputs & GREEN) {FastPin<GRN_PIN>::write(!on);}
+  if (outputs & HORN) {FastPin<HRN_PIN>::write(!on);}
+  if (outputs & LED) {FastPin<LED_MEGA_ONBOARD>::write(on);}
 }
 
+void Output::setRow(uint8_t row, const char *message, bool flash) {
+  uint32_t changed = 0;
+  bool ended = false;
+  for (uint8_t col = 0; col < LCD_columns; col++) {
+    char c = ' ';
+    if (!ended) {
+      c = flash ? pgm_read_byte(message + col) : message[col];
+      if (c == 0) {ended = true; c = ' ';}
+    }
+    uint8_t cell = row*LCD_columns + col;
+    if (frame[cell] == c) {continue;}
+    frame[cell] = c; // Before the cell is marked, so flush() never sends the old character and clears the mark
+    changed |= (uint32_t)1 << cell;
+  }
+  uint8_t oldSREG = SREG; cli();
+  dirty |= changed;
+  SREG = oldSREG;
+}
 
+void Output::send(uint8_t value, bool data) {
+  // RS and the data lines go out in one store, then the LCD latches them as EN falls (high nibble first)
+  typedef FastPins<LCD_RS, LCD_D4, LCD_D5, LCD_D6, LCD_D7> Bus;
+  for (int shift = 4; shift >= 0; shift -= 4) {
+    uint8_t nibble = value >> shift;
+    uint8_t bits = data ? FastPin<LCD_RS>::MASK : 0;
+    if (nibble & 0x01) {bits |= FastPin<LCD_D4>::MASK;}
+    if (nibble & 0x02) {bits |= FastPin<LCD_D5>::MASK;}
+    if (nibble & 0x04) {bits |= FastPin<LCD_D6>::MASK;}
+    if (nibble & 0x08) {bits |= FastPin<LCD_D7>::MASK;}
+    Bus::set(bits);
+    FastPin<LCD_EN>::high();
+    delayMicroseconds(1); // EN pulse at least 450 ns
+    FastPin<LCD_EN>::low();
+    delayMicroseconds(1); // EN cycle at least 1 us
+  }
+}
@@ -3,6 +3,7 @@
 
 #include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
 #include <LiquidCrystal.h>
+#include "FastPin.h"
 
 class Output {
 
@@ -27,44 +28,91 @@ class Output {
         void ledOff();
         void ledToggle();
 
-        void setLight(int light);
-        void toggle();
+        void setLight(int light);   // Blink a light: 0 none, 1 red, 2 yellow, 3 green
 
-        void randomLight();
+        void randomLight();         // Walk the tower through a shuffle of lights (returns at once)
 
         // Horn works a little differently
-        void hornBlast(int duration); // Provide a length of time for the horn to sound in milliseconds
+        void hornBlast(int duration); // Provide a length of time for the horn to sound in milliseconds (returns at once)
+        void hornChirp();           // Three short chirps (returns at once)
+
+        // Outputs a pattern step can turn on
+        static const uint8_t RED = 0x01;
+        static const uint8_t YELLOW = 0x02;
+        static const uint8_t GREEN = 0x04;
+        static const uint8_t HORN = 0x08;
+        static const uint8_t LED = 0x10;
+        static const uint8_t REPEAT = 0x80; // In the closing step: start over rather than stop
+        static const uint8_t LCD = 0x20;    // selfTest() only: an LCD pin
+
+        // One step of a light or horn pattern: these outputs on (the rest of the pattern's off) for "ms".
+        // A pattern is an array of them in flash, closed by a step with ms = 0.
+        struct Step {
+            uint8_t outputs;
+            uint16_t ms;
+        };
 
         // LCD Operations
         void printTop(const char *message);
         void printBottom(const char *message);
         void printMessage(const char *topMessage, const char *bottomMessage);
+        void printTop(const __FlashStringHelper *message);    // Same, for a message kept in flash
+        void printBottom(const __FlashStringHelper *message);
+        void printMessage(const __FlashStringHelper *topMessage, const __FlashStringHelper *bottomMessage);
+        void tick();        // Scheduler task, every ms in the tick interrupt: steps the light and horn patterns
+        void flush();       // Scheduler task, every ms in the background: sends the LCD at most one byte
+        bool drawn();       // The LCD shows everything printed so far
+        uint8_t selfTest(); // Boot check: the outputs (bits above) whose pins do not read back as driven
         
 
 
     private:
         // ADD ALL REQUIRED PINS AS CONST INT
-        const int RED_PIN = 14;       // OUTPUT, red stack light
-        const int YLW_PIN = 15;       // OUTPUT, yellow stack light
-        const int GRN_PIN = 16;       // OUTPUT, green stack light
-        const int HRN_PIN = 17;       // OUTPUT, alarm horn
+        static const int RED_PIN = 14;       // OUTPUT, red stack light
+        static const int YLW_PIN = 15;       // OUTPUT, yellow stack light
+        static const int GRN_PIN = 16;       // OUTPUT, green stack light
+        static const int HRN_PIN = 17;       // OUTPUT, alarm horn
         // ALSO ADD ANY OTHER REQUIRED FUNCTIONS AS PRIVATE FUNCTIONS
 
-        const int LCD_RS = 44;         // OUTPUT, LCD reset
-        const int LCD_EN = 45;         // OUTPUT, LCD enable
-        const int LCD_D4 = 46;         // OUTPUT, LCD 4-bit data
-        const int LCD_D5 = 47;         // OUTPUT, LCD 4-bit data
-        const int LCD_D6 = 48;         // OUTPUT, LCD 4-bit data
-        const int LCD_D7 = 49;         // OUTPUT, LCD 4-bit data
-
-        const int LCD_columns = 16; // display number of characters wide
-        const int LCD_rows = 2; // display number of rows
-
-        const int LED_MEGA_ONBOARD = 13; // OUTPUT, green LED on ATMega 2560 PCBA main board
-
-        int currentLight = 0; // Current light for blinking
-
-        LiquidCrystal *lcd;
+        static const int LCD_RS = 44;         // OUTPUT, LCD reset
+        static const int LCD_EN = 45;         // OUTPUT, LCD enable
+        static const int LCD_D4 = 46;         // OUTPUT, LCD 4-bit data
+        static const int LCD_D5 = 47;         // OUTPUT, LCD 4-bit data
+        static const int LCD_D6 = 48;         // OUTPUT, LCD 4-bit data
+        static const int LCD_D7 = 49;         // OUTPUT, LCD 4-bit data
+
+        static const int LCD_columns = 16; // display number of characters wide
+        static const int LCD_rows = 2; // display number of rows
+
+        static const int LED_MEGA_ONBOARD = 13; // OUTPUT, green LED on ATMega 2560 PCBA main board
+
+        // A pattern playing. The tick only touches the outputs of the step it is on, so lights the sketch
+        // switches itself are left alone unless a pattern uses them too.
+        struct Track {
+            const Step *first;      // Pattern (in flash), or NULL when nothing is playing
+            const Step *step;       // Step it is on
+            uint16_t left;          // ms left in that step
+            uint8_t on;             // Outputs the track has on
+        };
+        Track lights;               // setLight() and randomLight()
+        Track horn;                 // hornBlast() and hornChirp()
+        Track heartbeat;            // Onboard LED
+
+        void play(Track &track, const Step *pattern); // Start a pattern over whatever the track was playing (NULL: stop)
+        void advance(Track &track); // One ms of a track
+        void show(Track &track, uint8_t outputs);     // Switch the track's outputs to "outputs"
+        void drive(uint8_t outputs, bool on);         // Switch outputs on or off
+
+        // LCD frame buffer. The print functions only write "frame" and mark the cells that changed; flush()
+        // sends them one byte at a time, skipping any cell that already shows the right character.
+        static const uint8_t CELLS = 32;        // 16x2, row-major; also "cursor unknown"
+        volatile char frame[CELLS];             // What the LCD should show
+        char shown[CELLS];                      // What it does show (flush() only)
+        volatile uint32_t dirty;                // Cells written since they were last sent
+        uint8_t cursor;                         // Cell the LCD writes next, or CELLS if not known (flush() only)
+
+        void setRow(uint8_t row, const char *message, bool flash); // Fill a row of the frame, padded with spaces
+        void send(uint8_t value, bool data);    // One byte to the LCD, as two nibbles
 
 };
 #endif
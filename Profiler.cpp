@@ -0,0 +1,163 @@
+// Phase timing and run history for Sequence; see Profiler.h. The EEPROM is only written by save(), one
+// record per run, so the time it takes never lands inside a phase.
+
+#include "Profiler.h"
+
+// Constructor: Provide default values
+Profiler::Profiler(int pAddress, const char * const *pMessages) {
+    address = pAddress;
+    messages = pMessages;
+    for (int i = 0; i < PHASES; i++) {run.time[i] = 0;}
+    phase = START;
+    pausedIn = START;
+    since = 0;
+    pausedAt = 0;
+    running = false;
+    unsaved = false;
+}
+
+void Profiler::close() {
+    unsigned long now = micros();
+    unsigned long elapsed = now - since;
+    since = now;
+    if (run.time[phase] > MAX_TIME - elapsed) {run.time[phase] = MAX_TIME;}
+    else {run.time[phase] += elapsed;}
+}
+
+uint8_t Profiler::saved() {
+    if (EEPROM.read(address) != PROFILE_VERSION) {return 0;} // Blank, or saved in another layout
+    return min(EEPROM.read(address + 2), HISTORY);
+}
+
+uint8_t Profiler::newest() {
+    return (EEPROM.read(address + 1) + HISTORY - 1) % HISTORY;
+}
+
+unsigned long Profiler::time(uint8_t slot, uint8_t phase) {
+    unsigned long us;
+    EEPROM.get(address + 3 + slot*sizeof(Record) + phase*sizeof(us), us);
+    return us;
+}
+
+unsigned long Profiler::sum(uint8_t slot) {
+    unsigned long us = 0;
+    for (uint8_t i = 0; i < PHASES; i++) {
+      if (i != PAUSED) {us += time(slot, i);}
+    }
+    return us;
+}
+
+void Profiler::printName(uint8_t phase) {
+    if (phase == START) {Serial.print(F("start"));}
+    else if (phase == PAUSED) {Serial.print(F("paused"));}
+    else {Serial.print((const __FlashStringHelper *)pgm_read_ptr(&messages[phase - MESSAGE]));}
+}
+
+void Profiler::printTime(unsigned long us) {
+    Serial.print(us/1000);
+    Serial.print('.');
+    unsigned long fraction = us % 1000;
+    if (fraction < 100) {Serial.print('0');}
+    if (fraction < 10) {Serial.print('0');}
+    Serial.print(fraction);
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ ******************************************************************************/
+void Profiler::begin() {
+    for (int i = 0; i < PHASES; i++) {run.time[i] = 0;}
+    phase = START;
+    since = micros();
+    running = true;
+    unsaved = false;
+}
+
+void Profiler::enter(uint8_t newPhase) {
+    if (!running || (phase == PAUSED) || (newPhase >= PHASES)) {return;}
+    close();
+    phase = newPhase;
+}
+
+void Profiler::pause() {
+    if (!running || (phase == PAUSED)) {return;}
+    close();
+    pausedIn = phase;
+    phase = PAUSED;
+    pausedAt = millis();
+}
+
+void Profiler::resume() {
+    if (!running || (phase != PAUSED)) {return;}
+    unsigned long ms = millis() - pausedAt;
+    unsigned long left = MAX_TIME - run.time[PAUSED];
+    run.time[PAUSED] += (ms > left/1000) ? left : ms*1000;
+    phase = pausedIn;
+    since = micros();
+}
+
+void Profiler::finish() {
+    if (!running) {return;}
+    close();
+    running = false;
+    unsaved = true;
+}
+
+void Profiler::abandon() {
+    running = false;
+}
+
+void Profiler::save() {
+    if (!unsaved) {return;}
+    unsaved = false;
+
+    uint8_t count = saved();
+    uint8_t next = (count == 0) ? 0 : EEPROM.read(address + 1);
+    EEPROM.put(address + 3 + next*sizeof(Record), run);
+    EEPROM.update(address + 1, (next + 1) % HISTORY);
+    EEPROM.update(address + 2, min(count + 1, HISTORY));
+    EEPROM.update(address, PROFILE_VERSION); // Last, so a reset part way through leaves the block blank
+}
+
+unsigned long Profiler::total() {
+    if (saved() == 0) {return 0;}
+    return sum(newest());
+}
+
+unsigned long Profiler::mean() {
+    uint8_t count = saved();
+    if (count == 0) {return 0;}
+    unsigned long us = 0;
+    for (uint8_t slot = 0; slot < count; slot++) {us += sum(slot)/count;}
+    return us;
+}
+
+void Profiler::report() {
+    uint8_t count = saved();
+    if (count == 0) {
+      Serial.println(F("  no runs saved"));
+      return;
+    }
+    Serial.print(F("  last run, then min/mean/max of ")); Serial.print(count); Serial.println(F(" runs (ms):"));
+
+    uint8_t last = newest();
+    for (uint8_t i = 0; i <= PHASES; i++) { // The extra one is the whole run
+      unsigned long lo = MAX_TIME, hi = 0, mean = 0;
+      for (uint8_t slot = 0; slot < count; slot++) {
+        unsigned long us = (i < PHASES) ? time(slot, i) : sum(slot);
+        lo = min(lo, us);
+        hi = max(hi, us);
+        mean += us/count;
+      }
+      if (hi == 0) {continue;} // Never used by this program
+
+      Serial.print(F("  "));
+      if (i < PHASES) {printName(i);}
+      else {Serial.print(F("total"));}
+      Serial.print(F(": ")); printTime((i < PHASES) ? time(last, i) : sum(last));
+      Serial.print(F("  (")); printTime(lo);
+      Serial.print(F(" / ")); printTime(mean);
+      Serial.print(F(" / ")); printTime(hi);
+      Serial.println(')');
+    }
+}
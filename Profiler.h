@@ -0,0 +1,71 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+#include <EEPROM.h>
+#include "EepromMap.h"
+
+// Phase timing for a program run by Sequence, to find out where the cycle time goes. The program's
+// LCD messages mark the phases: a phase starts when the program shows its message and runs until the
+// next one, so the load program's phases are the arm motions, securing the payload, erecting the rail
+// and inserting the ignitor. The time before the first message (homing the arm before a load) is the
+// START phase, and the time spent paused is kept apart as PAUSED. Times are taken with micros().
+//
+// A run that gets to the end can be saved to a ring of the last HISTORY runs in EEPROM, and report()
+// prints the last run against the min/mean/max of the saved ones. A run that ends in an error is not
+// saved; it says nothing about the cycle time. Saving takes a while (a few ms per changed byte), so it
+// is left to the sketch to do once the arm is at rest and the LCD has been updated.
+class Profiler {
+
+    public:
+        // Phases
+        static const uint8_t START = 0;     // Before the program's first message
+        static const uint8_t PAUSED = 1;    // Paused, whichever phase it was in
+        static const uint8_t MESSAGE = 2;   // MESSAGE + n: from message n to the next message
+        static const uint8_t PHASES = 10;   // So messages 0-7 are timed
+
+        static const uint8_t HISTORY = 8;   // Runs kept in EEPROM
+
+        Profiler(int pAddress, const char * const *pMessages); // Constructor; "pAddress" is its EEPROM
+                                            // block, "pMessages" the PROGMEM message table (for names)
+        void begin();                       // A run starts from the top of its program
+        void enter(uint8_t phase);          // The run moves on to "phase"
+        void pause();                       // The run stops; the time until resume() counts as PAUSED
+        void resume();                      // The run carries on in the phase it paused in
+        void finish();                      // The run got to the end; stop the clock
+        void abandon();                     // The run ended in an error; forget it
+        void save();                        // Add the finished run to the history (once; up to ~150 ms)
+        unsigned long total();              // Last finished run, pauses left out (us)
+        unsigned long mean();               // Mean of that over the saved runs (us)
+        void report();                      // Print the last run and the saved ones to the serial port
+
+    private:
+        static const uint8_t PROFILE_VERSION = 1; // Layout of the EEPROM block; bump it when Record changes
+        static const unsigned long MAX_TIME = 0xFFFFFFFFUL; // A phase longer than this (71 min) is cut off
+
+        // One run, as saved: the time in each phase (us)
+        struct Record {
+            unsigned long time[PHASES];
+        };
+
+        int address;                        // EEPROM block: version, next slot, runs saved, then the ring
+        const char * const *messages;       // PROGMEM table of PROGMEM strings
+
+        Record run;                         // Run under way
+        uint8_t phase;                      // Phase the run is in
+        uint8_t pausedIn;                   // Phase it paused in
+        unsigned long since;                // micros() when "phase" was entered
+        unsigned long pausedAt;             // millis() when it paused (a pause can outlast micros())
+        bool running;                       // A run is under way (paused or not)
+        bool unsaved;                       // A run has finished and not been saved yet
+
+        void close();                       // Add the time since "since" to the current phase
+        uint8_t saved();                    // Runs in the history
+        uint8_t newest();                   // Slot of the last run saved
+        unsigned long time(uint8_t slot, uint8_t phase); // Time of a saved run in a phase (us)
+        unsigned long sum(uint8_t slot);    // Time of a saved run, pauses left out (us)
+        void printName(uint8_t phase);
+        void printTime(unsigned long us);   // As ms, with three decimals
+};
+
+#endif
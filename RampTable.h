@@ -0,0 +1,80 @@
+#ifndef RAMPTABLE_H
+#define RAMPTABLE_H
+
+#include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+
+// Step period lookup for the step ISRs in Axis.cpp, stored in flash. Entry i holds half the period (in
+// 0.5 us timer ticks) of a step at a speed whose square is (256 + i), i.e. round(1000000/sqrt(256 + i)).
+// Any other speed squared is scaled by powers of four into the range 256..1023 first, and the result
+// is shifted back by the matching power of two, so one table covers every speed on both axes.
+const int RAMP_TABLE_MIN = 256;   // Smallest normalised speed squared in the table
+const int RAMP_TABLE_MAX = 1024;  // One past the largest
+
+const uint16_t RAMP_HALF_PERIOD[RAMP_TABLE_MAX - RAMP_TABLE_MIN] PROGMEM = {
+    62500, 62378, 62257, 62137, 62017, 61898, 61780, 61663, 61546, 61430, 61314, 61199,
+    61085, 60971, 60858, 60746, 60634, 60523, 60412, 60302, 60193, 60084, 59976, 59868,
+    59761, 59655, 59549, 59444, 59339, 59235, 59131, 59028, 58926, 58824, 58722, 58621,
+    58521, 58421, 58321, 58222, 58124, 58026, 57928, 57831, 57735, 57639, 57544, 57448,
+    57354, 57260, 57166, 57073, 56980, 56888, 56796, 56705, 56614, 56523, 56433, 56344,
+    56254, 56166, 56077, 55989, 55902, 55815, 55728, 55641, 55556, 55470, 55385, 55300,
+    55216, 55132, 55048, 54965, 54882, 54800, 54718, 54636, 54554, 54473, 54393, 54313,
+    54233, 54153, 54074, 53995, 53916, 53838, 53760, 53683, 53606, 53529, 53452, 53376,
+    53300, 53225, 53149, 53074, 53000, 52926, 52852, 52778, 52705, 52632, 52559, 52486,
+    52414, 52342, 52271, 52200, 52129, 52058, 51988, 51917, 51848, 51778, 51709, 51640,
+    51571, 51503, 51434, 51367, 51299, 51232, 51164, 51098, 51031, 50965, 50899, 50833,
+    50767, 50702, 50637, 50572, 50508, 50443, 50379, 50315, 50252, 50189, 50125, 50063,
+    50000, 49938, 49875, 49814, 49752, 49690, 49629, 49568, 49507, 49447, 49386, 49326,
+    49266, 49207, 49147, 49088, 49029, 48970, 48912, 48853, 48795, 48737, 48679, 48622,
+    48564, 48507, 48450, 48393, 48337, 48280, 48224, 48168, 48113, 48057, 48002, 47946,
+    47891, 47836, 47782, 47727, 47673, 47619, 47565, 47511, 47458, 47405, 47351, 47298,
+    47246, 47193, 47140, 47088, 47036, 46984, 46932, 46881, 46829, 46778, 46727, 46676,
+    46625, 46575, 46524, 46474, 46424, 46374, 46324, 46274, 46225, 46176, 46127, 46078,
+    46029, 45980, 45932, 45883, 45835, 45787, 45739, 45691, 45644, 45596, 45549, 45502,
+    45455, 45408, 45361, 45314, 45268, 45222, 45175, 45129, 45083, 45038, 44992, 44947,
+    44901, 44856, 44811, 44766, 44721, 44677, 44632, 44588, 44544, 44499, 44455, 44412,
+    44368, 44324, 44281, 44237, 44194, 44151, 44108, 44065, 44023, 43980, 43937, 43895,
+    43853, 43811, 43769, 43727, 43685, 43644, 43602, 43561, 43519, 43478, 43437, 43396,
+    43355, 43315, 43274, 43234, 43193, 43153, 43113, 43073, 43033, 42993, 42954, 42914,
+    42875, 42835, 42796, 42757, 42718, 42679, 42640, 42601, 42563, 42524, 42486, 42448,
+    42409, 42371, 42333, 42295, 42258, 42220, 42182, 42145, 42108, 42070, 42033, 41996,
+    41959, 41922, 41885, 41849, 41812, 41776, 41739, 41703, 41667, 41631, 41595, 41559,
+    41523, 41487, 41451, 41416, 41380, 41345, 41310, 41274, 41239, 41204, 41169, 41135,
+    41100, 41065, 41030, 40996, 40962, 40927, 40893, 40859, 40825, 40791, 40757, 40723,
+    40689, 40656, 40622, 40589, 40555, 40522, 40489, 40456, 40423, 40390, 40357, 40324,
+    40291, 40258, 40226, 40193, 40161, 40129, 40096, 40064, 40032, 40000, 39968, 39936,
+    39904, 39873, 39841, 39809, 39778, 39746, 39715, 39684, 39653, 39621, 39590, 39559,
+    39528, 39498, 39467, 39436, 39406, 39375, 39344, 39314, 39284, 39253, 39223, 39193,
+    39163, 39133, 39103, 39073, 39043, 39014, 38984, 38954, 38925, 38895, 38866, 38837,
+    38808, 38778, 38749, 38720, 38691, 38662, 38633, 38605, 38576, 38547, 38519, 38490,
+    38462, 38433, 38405, 38376, 38348, 38320, 38292, 38264, 38236, 38208, 38180, 38152,
+    38125, 38097, 38069, 38042, 38014, 37987, 37959, 37932, 37905, 37878, 37851, 37823,
+    37796, 37769, 37743, 37716, 37689, 37662, 37635, 37609, 37582, 37556, 37529, 37503,
+    37477, 37450, 37424, 37398, 37372, 37346, 37320, 37294, 37268, 37242, 37216, 37190,
+    37165, 37139, 37113, 37088, 37062, 37037, 37012, 36986, 36961, 36936, 36911, 36886,
+    36860, 36835, 36811, 36786, 36761, 36736, 36711, 36686, 36662, 36637, 36613, 36588,
+    36564, 36539, 36515, 36491, 36466, 36442, 36418, 36394, 36370, 36346, 36322, 36298,
+    36274, 36250, 36226, 36202, 36179, 36155, 36131, 36108, 36084, 36061, 36037, 36014,
+    35991, 35968, 35944, 35921, 35898, 35875, 35852, 35829, 35806, 35783, 35760, 35737,
+    35714, 35692, 35669, 35646, 35624, 35601, 35578, 35556, 35533, 35511, 35489, 35466,
+    35444, 35422, 35400, 35377, 35355, 35333, 35311, 35289, 35267, 35245, 35223, 35202,
+    35180, 35158, 35136, 35115, 35093, 35072, 35050, 35028, 35007, 34986, 34964, 34943,
+    34922, 34900, 34879, 34858, 34837, 34816, 34794, 34773, 34752, 34731, 34711, 34690,
+    34669, 34648, 34627, 34606, 34586, 34565, 34544, 34524, 34503, 34483, 34462, 34442,
+    34421, 34401, 34381, 34360, 34340, 34320, 34300, 34280, 34259, 34239, 34219, 34199,
+    34179, 34159, 34139, 34120, 34100, 34080, 34060, 34040, 34021, 34001, 33981, 33962,
+    33942, 33923, 33903, 33884, 33864, 33845, 33826, 33806, 33787, 33768, 33748, 33729,
+    33710, 33691, 33672, 33653, 33634, 33615, 33596, 33577, 33558, 33539, 33520, 33501,
+    33482, 33464, 33445, 33426, 33408, 33389, 33370, 33352, 33333, 33315, 33296, 33278,
+    33260, 33241, 33223, 33204, 33186, 33168, 33150, 33131, 33113, 33095, 33077, 33059,
+    33041, 33023, 33005, 32987, 32969, 32951, 32933, 32915, 32898, 32880, 32862, 32844,
+    32827, 32809, 32791, 32774, 32756, 32739, 32721, 32703, 32686, 32669, 32651, 32634,
+    32616, 32599, 32582, 32564, 32547, 32530, 32513, 32496, 32478, 32461, 32444, 32427,
+    32410, 32393, 32376, 32359, 32342, 32325, 32309, 32292, 32275, 32258, 32241, 32225,
+    32208, 32191, 32174, 32158, 32141, 32125, 32108, 32092, 32075, 32059, 32042, 32026,
+    32009, 31993, 31976, 31960, 31944, 31928, 31911, 31895, 31879, 31863, 31846, 31830,
+    31814, 31798, 31782, 31766, 31750, 31734, 31718, 31702, 31686, 31670, 31654, 31639,
+    31623, 31607, 31591, 31575, 31560, 31544, 31528, 31513, 31497, 31481, 31466, 31450,
+    31435, 31419, 31404, 31388, 31373, 31357, 31342, 31327, 31311, 31296, 31281, 31265
+};
+
+#endif
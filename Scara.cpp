@@ -1,217 +1,539 @@
 // Class to handle movement of the SCARA robotic arm. This class controls the motion of two stepper motors,
-// which move in the vertical and horizontal directions. It also monitors for the depression of microswitches
-// corresponding to the current travel direction.
+// which move in the vertical and horizontal directions. The step pulses themselves come from the timer
+// interrupts in the "Axis" class, which also monitors for the depression of microswitches corresponding
+// to the current travel direction.
+//
+// The class keeps the arm's absolute position in steps from the home switches. Every motion adds the
+// steps it actually ran, and stopping on a home switch sets that axis back to zero. The position is
+// saved to EEPROM whenever the arm comes to rest. It is marked stale before the arm moves, so a reset
+// part way through a motion forces a full search next time. With a trusted position, home() is a
+// short direct move followed by a slow approach onto each switch.
+//
+// The arm is cylindrical: the rotational motor swings the gripper on a fixed radius and the linear
+// motor raises it, so the gripper only ever moves on the surface of a cylinder and a combined motion
+// (one motor stepped along with the other) is already the straight line between its two end points
+// on that surface. What costs time is the corner where one motor stops and the other starts; a
+// motion with a blend lets the next one start before it has finished, which rounds the corner off.
 //
 // Currently, all constants are stored internally in the class. If we start to hit memory issues we can
 // change these to preprocessor directives, but I want to hold off on that unless absolutely necessary.
 
 #include "Scara.h"
-#include "math.h"
 
 // Constructor: Set all relevant pins to "output" and provide default values
-Scara::Scara(volatile bool *pFlag) { // Pass in the global pause flag by reference for internal use
-    // Build pin index arrays: Rotational motor is pin index "0," linear motor is pin index "1"
-    directionPins[0] = ROT_DIR_PIN; directionPins[1] = LIN_DIR_PIN;
-    pulsePins[0] = ROT_PUL_PIN; pulsePins[1] = LIN_PUL_PIN;
-    switchPins[0] = ROT_PLS_PIN; switchPins[1] = ROT_MIN_PIN;
-    switchPins[2] = LIN_PLS_PIN; switchPins[3] = LIN_MIN_PIN;
-
+// Rotational motor is pin index "0," linear motor is pin index "1"
+Scara::Scara(volatile bool *pFlag) : // Pass in the global pause flag by reference for internal use
+    rot(3, FastPin<ROT_DIR_PIN>::ref(), FastPin<ROT_PUL_PIN>::ref(),
+        FastPin<ROT_PLS_PIN>::ref(), FastPin<ROT_MIN_PIN>::ref(), pFlag),
+    lin(4, FastPin<LIN_DIR_PIN>::ref(), FastPin<LIN_PUL_PIN>::ref(),
+        FastPin<LIN_PLS_PIN>::ref(), FastPin<LIN_MIN_PIN>::ref(), pFlag) {
     // Set all rotational and linear pins to output
-    pinMode(RELAY_PWR_PIN, OUTPUT);
-    pinMode(ROT_DIR_PIN, OUTPUT); 
-    pinMode(ROT_PUL_PIN, OUTPUT);
-    pinMode(ROT_ENA_PIN, OUTPUT);
-    pinMode(ROT_PLS_PIN, INPUT_PULLUP);
-    pinMode(ROT_MIN_PIN, INPUT_PULLUP);
+    FastPin<RELAY_PWR_PIN>::output();
+    FastPin<ROT_DIR_PIN>::output();
+    FastPin<ROT_PUL_PIN>::output();
+    FastPin<ROT_ENA_PIN>::output();
+    FastPin<ROT_PLS_PIN>::inputPullup();
+    FastPin<ROT_MIN_PIN>::inputPullup();
     
-    pinMode(LIN_DIR_PIN, OUTPUT);
-    pinMode(LIN_PUL_PIN, OUTPUT);
-    pinMode(LIN_ENA_PIN, OUTPUT);
-    pinMode(LIN_PLS_PIN, INPUT_PULLUP);
-    pinMode(LIN_MIN_PIN, INPUT_PULLUP);
+    FastPin<LIN_DIR_PIN>::output();
+    FastPin<LIN_PUL_PIN>::output();
+    FastPin<LIN_ENA_PIN>::output();
+    FastPin<LIN_PLS_PIN>::inputPullup();
+    FastPin<LIN_MIN_PIN>::inputPullup();
     
     // Write all output pins to "low"
-    digitalWrite(ROT_DIR_PIN, LOW);
-    digitalWrite(LIN_DIR_PIN, LOW);
-    digitalWrite(ROT_PUL_PIN, LOW);
-    digitalWrite(LIN_PUL_PIN, LOW);
+    FastPin<ROT_DIR_PIN>::low();
+    FastPin<LIN_DIR_PIN>::low();
+    FastPin<ROT_PUL_PIN>::low();
+    FastPin<LIN_PUL_PIN>::low();
     
     // Write "enable" pins HIGH to disable the motors
     // (Might be causing motor hiccups)
-    digitalWrite(ROT_ENA_PIN, HIGH);
-    digitalWrite(LIN_ENA_PIN, HIGH);
+    FastPin<ROT_ENA_PIN>::high();
+    FastPin<LIN_ENA_PIN>::high();
 
     // Write relay power pin to HIGH (to disable the relays/motors)
     // (Might be causing motor hiccups)
-    digitalWrite(RELAY_PWR_PIN, HIGH);
+    FastPin<RELAY_PWR_PIN>::high();
 
     pauseFlag = pFlag; // Set global pause flag reference
+
+    // Pick up where the arm was left, if it was saved at rest in this layout
+    rotPos = 0;
+    linPos = 0;
+    known = false;
+    powerCut = false;
+    powerState = POWER_OFF;
+    powerSince = 0;
+    motionCount = 0;
+    if ((EEPROM.read(EEPROM_SCARA) == POSITION_VERSION) && (EEPROM.read(EEPROM_SCARA + 1) == 1)) {
+      EEPROM.get(EEPROM_SCARA + 2, rotPos);
+      EEPROM.get(EEPROM_SCARA + 2 + sizeof(rotPos), linPos);
+      known = true;
+    }
 }
 
+// The relay and the drivers are switched a second apart, so the supply has settled before the drivers
+// take the motors. enable() and disable() do the first half and return; power(), a scheduler task, does
+// the second half once the second is up. A motion started in between waits for the drivers.
 void Scara::enable() {
   // Safely enable the motors for motion
   // Ensure the "enable" pins are HIGH
-  digitalWrite(LIN_ENA_PIN, HIGH);
-  digitalWrite(ROT_ENA_PIN, HIGH);
+  FastPin<LIN_ENA_PIN>::high();
+  FastPin<ROT_ENA_PIN>::high();
+
+  // Close the stepper power relay; power() sets the "enable" pins LOW a second from now
+  uint8_t oldSREG = SREG; cli();
+  FastPin<RELAY_PWR_PIN>::low();
+  powerState = POWERING_UP;
+  powerSince = millis();
+  powerCut = false;
+  SREG = oldSREG;
+}
 
-  // Close the stepper power relay
-  digitalWrite(RELAY_PWR_PIN, LOW);
+void Scara::disable() {
+  // Safely disable the motors
+  // Write "enable" pin HIGH to disable the motors; power() opens the relay a second from now
+  uint8_t oldSREG = SREG; cli();
+  FastPin<LIN_ENA_PIN>::high();
+  FastPin<ROT_ENA_PIN>::high();
+  powerState = POWERING_DOWN;
+  powerSince = millis();
+  SREG = oldSREG;
+}
 
-  // Wait a second
-  delay(1000);
+void Scara::power() {
+  if ((powerState != POWERING_UP) && (powerState != POWERING_DOWN)) {return;}
+  if (millis() - powerSince < POWER_SETTLE) {return;}
+
+  // A cutPower() between the check and the switch would be undone, so switch with interrupts off
+  uint8_t oldSREG = SREG; cli();
+  if (powerState == POWERING_UP) {
+    // Set "enable" pins LOW to enable the motors
+    FastPin<LIN_ENA_PIN>::low();
+    FastPin<ROT_ENA_PIN>::low();
+    powerState = POWER_ON;
+  }
+  else if (powerState == POWERING_DOWN) {
+    // Open the stepper power relay
+    FastPin<RELAY_PWR_PIN>::high();
+    powerState = POWER_OFF;
+  }
+  SREG = oldSREG;
+}
 
-  // Set "enable" pins LOW to enable the motors
-  digitalWrite(LIN_ENA_PIN, LOW);
-  digitalWrite(ROT_ENA_PIN, LOW);
+bool Scara::powered() {
+  return powerState == POWER_ON;
 }
 
-void Scara::disable() {
-  // Safely disable the motors
-  // Write "enable" pin HIGH to disable the motors
-  digitalWrite(LIN_ENA_PIN, HIGH);
-  digitalWrite(ROT_ENA_PIN, HIGH);
-
-  // wait a second
-  delay(1000);
-
-  // Open the stepper power relay
-  digitalWrite(RELAY_PWR_PIN, HIGH);
-}
-
-// Set internal states for automated routine
-void Scara::setStates(int moCount, float floatDistances[], bool intMotors[]) {
-
-    // Set up the internal state distances
-    motionCount = moCount;
-    for(int i = 0; i < motionCount; i++){ // For each motion
-      // Set the boolean motor values
-      internalMotors[i] = intMotors[i];
-      
-      // Set the number of steps for each motion
-      if (internalMotors[i] == 0) { // Rotational motion
-        float factor = (float)(ROT_STEP_PER_DEG);
-        internalDistances[i] = (long)(factor*floatDistances[i]);
-      }
-      else { // Linear motion
-        float factor = (float)(LIN_STEP_PER_CM);
-        internalDistances[i] = (long)(factor*floatDistances[i]);
-      }
-    }
-    return;
+uint8_t Scara::selfTest() {
+  // A travel switch can only close at its own end, so both ends closed at once is a short or a stuck
+  // switch; homing would stop on it. The power pins are read back to catch a shorted output.
+  uint8_t faults = 0;
+  if (!FastPin<ROT_PLS_PIN>::read() && !FastPin<ROT_MIN_PIN>::read()) {faults |= ROT_SWITCHES;}
+  if (!FastPin<LIN_PLS_PIN>::read() && !FastPin<LIN_MIN_PIN>::read()) {faults |= LIN_SWITCHES;}
+  if (FastPin<RELAY_PWR_PIN>::stuck() || FastPin<ROT_ENA_PIN>::stuck() || FastPin<LIN_ENA_PIN>::stuck()) {
+    faults |= MOTOR_POWER;
+  }
+  if (!powered()) {faults |= MOTOR_POWER;} // Call it once enable() has had time to finish
+  return faults;
+}
+
+bool Scara::waitForPower() {
+  while (powerState == POWERING_UP) {
+    if (*pauseFlag) {return false;}
+    yield(); // power() runs from here
+  }
+  return true;
+}
+
+bool Scara::moving() {
+  return rot.busy() || lin.busy();
+}
+
+unsigned long Scara::brakeTime() {
+  // A pause brakes each motor at its own stop rate (or less), from no more than its top speed (combined
+  // motions scale both down together). Round up to the next ms.
+  return max((1000*ROT_MAX_SPEED + ROT_STOP_DECEL - 1)/ROT_STOP_DECEL,
+             (1000*LIN_MAX_SPEED + LIN_STOP_DECEL - 1)/LIN_STOP_DECEL);
+}
+
+void Scara::cutPower() {
+  // Drivers off first (they let go of the motors at once), then the relay, then stop the pulses
+  FastPin<ROT_ENA_PIN>::high();
+  FastPin<LIN_ENA_PIN>::high();
+  FastPin<RELAY_PWR_PIN>::high();
+  rot.kill(-1);
+  lin.kill(-1);
+  powerCut = true;
+  powerState = POWER_OFF; // So a power() still to come does not turn the drivers back on
 }
 
 bool Scara::homed() {
   // Check if the arm is at its "home" state - full outboard, full down
-  return ((!digitalRead(LIN_MIN_PIN) && !digitalRead(ROT_PLS_PIN)));
-}
-
-long Scara::pulseTrain(int pin, int switchIndex, long steps, long startSpeed, long accelRate) {
-  long counter = 0;
-  float period;
-  float currentSpeed = float(startSpeed);
-  while(counter < steps){
-    // Check for any limit switches;
-    if (!digitalRead(switchPins[switchIndex])) { // Not sure about logic here
-        errorCode = switchIndex + 1; // Set internal error code
-        return counter;
-    }
-    if (*pauseFlag) { // If pause flag is flipped
-      
-      errorCode = -1;
-      return counter;
-    }
-    period = M/currentSpeed; // Current period in microseconds
-    pulse(pin, (int)(period)); // I think this is slowing us down...
-    currentSpeed += accelRate*period/M;
-    counter++;
-  }
-  
-  return counter; // Need to make sure this returns the accurate number
+  return ((!FastPin<LIN_MIN_PIN>::read() && !FastPin<ROT_PLS_PIN>::read()));
 }
 
+long Scara::toSteps(long centiDistance, long stepsPerUnit) {
+    // Distances are fixed point, in hundredths of a cm or degree; round to the nearest step
+    long scaled = centiDistance*stepsPerUnit;
+    return (scaled + ((scaled < 0) ? -50 : 50))/100;
+}
 
-void Scara::pulse(int pin, int period) {
-  period = (int)(period*0.5);
-  digitalWrite(pin, HIGH);
-  delayMicroseconds(period);
-  digitalWrite(pin, LOW);
-  delayMicroseconds(period);
+long Scara::toCenti(long steps, long stepsPerUnit) {
+    // The other way, to the nearest hundredth; steps*100 fits in a long for any travel the arm has
+    long scaled = steps*100;
+    long half = stepsPerUnit/2;
+    return (scaled + ((scaled < 0) ? -half : half))/stepsPerUnit;
 }
 
+void Scara::track(int pinIndex, long moved, int status) {
+    long &pos = (pinIndex == 0) ? rotPos : linPos;
+    pos += moved;
+    // The home switches define zero, so stopping on one puts the count right again
+    if (status == ((pinIndex == 0) ? 1 : 2)) {pos = 0;}
+}
 
-long Scara::runMotor(int pinIndex, long steps, long maxSpeed, long accel) {
-    if (steps == 0) {return 0;} // Exit immediately if 0 steps required
-    if ((pinIndex != 0) && (pinIndex != 1)) { return 0;} // Exit immediately for bad pin index
+void Scara::savePosition(bool valid) {
+    // Only changed bytes are written. The flag is cleared before the arm moves and set again after the
+    // position, so a reset part way through either leaves the position marked unknown.
+    if (!valid) {
+      EEPROM.update(EEPROM_SCARA + 1, 0);
+      return;
+    }
+    EEPROM.update(EEPROM_SCARA, POSITION_VERSION);
+    EEPROM.put(EEPROM_SCARA + 2, rotPos);
+    EEPROM.put(EEPROM_SCARA + 2 + sizeof(rotPos), linPos);
+    EEPROM.update(EEPROM_SCARA + 1, 1);
+}
 
-    float accelSteps = ((float)(maxSpeed)*(float)(maxSpeed))/((float)(accel)*2.0);
-    float decelSteps;
-    float constSteps;
+void Scara::makeProfile(Profile &profile, long steps, long maxSpeed, long accel, long jerk) {
+    // Start and finish at sqrt(accel) steps per second, as before
+    makeProfile(profile, steps, maxSpeed, accel, jerk, accel, accel);
+}
+
+void Scara::makeProfile(Profile &profile, long steps, long maxSpeed, long accel, long jerk,
+                        unsigned long startSpeed2, unsigned long endSpeed2) {
+    // All speeds are squared, so the whole profile is integer math (v^2 = v0^2 + 2*a*steps)
+    unsigned long maxSpeed2 = (unsigned long)(maxSpeed)*maxSpeed;
+    unsigned long accel2 = 2*accel;
+    long accelSteps = (maxSpeed2 - startSpeed2)/accel2;
+    long decelSteps = (maxSpeed2 - endSpeed2)/accel2;
+    long constSteps;
     int dir = (steps > 0) - (steps < 0); // Get sign of the motion; no standard "sign" function in C++
     steps = abs(steps); // Change "steps" to absolute value
 
-    // Handle microswitch indexing
-    // Serial.print("dir = "); Serial.println(dir);
-    int switchIndex;
-    if (dir == 1) { // Moving in positive direction
-        switchIndex = 2*pinIndex;
-    }
-    else { // Otherwise, moving in the negative direction
-        switchIndex = 2*pinIndex + 1;
-    }
-
-    // Serial.print("pinIndex = "); Serial.println(pinIndex);
-   // Serial.print("switchIndex = "); Serial.println(switchIndex);
+    profile.jerk = 0;
+    profile.accelEase2 = 0;
+    profile.decelEase2 = 0;
+    if (jerk > 0) { // S-curve; planned in floating point once per motion, the ISR stays integer
+      // The ISR grows accel2 (in 1/65536ths) by "jerk" per 0.5 us tick: 2*jerk*65536/2000000 per tick.
+      // Plan with the jerk that rounding leaves, so the ramps come out where the ISR puts them.
+      profile.jerk = max(1L, (jerk*65536L + 500000L)/1000000L);
+      jerk = ((long)(profile.jerk)*1000000L + 32768L)/65536L;
+
+      float v0 = sqrt((float)(startSpeed2));
+      float v2 = sqrt((float)(endSpeed2));
+      float peak = maxSpeed;
+      if (rampSteps(v0, peak, accel, jerk) + rampSteps(peak, v2, accel, jerk) > steps) {
+        // Cannot reach cruise speed; find the peak the two ramps meet at
+        float low = max(v0, v2);
+        for (int i = 0; i < 16; i++) {
+          float mid = (low + peak)/2;
+          if (rampSteps(v0, mid, accel, jerk) + rampSteps(mid, v2, accel, jerk) > steps) {peak = mid;}
+          else {low = mid;}
+        }
+        peak = low;
+      }
 
+      // Round the ramps up; when they do not fit, the acceleration is cut short
+      accelSteps = (long)(rampSteps(v0, peak, accel, jerk)) + 1;
+      decelSteps = (long)(rampSteps(peak, v2, accel, jerk)) + 1;
+      decelSteps = min(decelSteps, steps);
+      accelSteps = min(accelSteps, steps - decelSteps);
+      constSteps = steps - (accelSteps + decelSteps);
+      maxSpeed2 = (unsigned long)(peak*peak);
+
+      // Each ramp eases out once the speed is within a^2/(2*j) of its target, a being the most
+      // acceleration the ramp reaches (less than "accel" for a short ramp)
+      float rise = min((float)(accel), sqrt(jerk*(peak - v0)));
+      float fall = min((float)(accel), sqrt(jerk*(peak - v2)));
+      float accelEase = peak - rise*rise/(2*jerk);
+      float decelEase = v2 + fall*fall/(2*jerk);
+      profile.accelEase2 = (unsigned long)(accelEase*accelEase);
+      profile.decelEase2 = (unsigned long)(decelEase*decelEase);
+    }
     // Determine whether motion profile is trapezoidal or triangular
-    if(accelSteps*2 >= steps){ // Triangular profile
+    else if(accelSteps + decelSteps >= steps){ // Triangular profile
       constSteps = 0;
-      accelSteps = steps/2;
-      decelSteps = steps/2;
-      maxSpeed = (int) sqrt(2.0*(float)(accel)*(accelSteps));
+      // Accelerate up to where the deceleration ramp down to the end speed crosses it
+      accelSteps = ((long)(endSpeed2) - (long)(startSpeed2) + (long)(accel2)*steps)/(long)(2*accel2);
+      accelSteps = constrain(accelSteps, 0, steps);
+      maxSpeed2 = startSpeed2 + accel2*accelSteps; // Peak speed, where acceleration stops
     }
     else // Trapezoidal profile
     {
-      decelSteps = accelSteps;
       constSteps = steps - (accelSteps + decelSteps);
     }
+    // Odd step counts leave one over; it goes to the deceleration phase so the counts always add up
+    decelSteps = steps - (accelSteps + constSteps);
+
+    profile.dir = dir;
+    profile.accelSteps = accelSteps;
+    profile.constSteps = constSteps;
+    profile.decelSteps = decelSteps;
+    profile.startSpeed2 = startSpeed2;
+    profile.endSpeed2 = endSpeed2;
+    profile.maxSpeed2 = maxSpeed2;
+    profile.accel2 = accel2;
+    profile.brake2 = accel2; // Callers set the pause braking rate
+    profile.slave = NULL;
+    profile.slaveDir = 0;
+    profile.slaveSteps = 0;
+    profile.cue = false;
+    profile.cueSteps = 0;
+}
+
+long Scara::jerkFor(int pinIndex) {
+    if (pinIndex == 0) {return (ROT_PROFILE == S_CURVE) ? ROT_JERK : 0;}
+    return (LIN_PROFILE == S_CURVE) ? LIN_JERK : 0;
+}
+
+long Scara::brakeFor(int pinIndex) {
+    return (pinIndex == 0) ? ROT_STOP_DECEL : LIN_STOP_DECEL;
+}
 
-    // Re-cast the step counts as long integers for use below
-    accelSteps = (long) accelSteps;
-    decelSteps = (long) decelSteps;
-    constSteps = (long) constSteps;
+float Scara::rampSteps(float fromSpeed, float toSpeed, long accel, long jerk) {
+    // A ramp is symmetric in time, so its length is the mean speed times its duration. With a jerk
+    // limit the acceleration takes accel/jerk to build up and as long to die away; a short ramp
+    // never reaches full acceleration.
+    float change = fabs(toSpeed - fromSpeed);
+    float time;
+    if (jerk <= 0) {time = change/accel;}
+    else if (change*jerk >= (float)(accel)*accel) {time = change/accel + (float)(accel)/jerk;}
+    else {time = 2*sqrt(change/jerk);}
+    return (fromSpeed + toSpeed)/2*time;
+}
 
-    // Set direction
-    if(dir > 0){
-        //Serial.println("Writing Voltage High");
-        digitalWrite(directionPins[pinIndex], HIGH);
+unsigned long Scara::reach2(unsigned long fromSpeed2, long steps, long maxSpeed, long accel, long jerk) {
+    unsigned long maxSpeed2 = (unsigned long)(maxSpeed)*maxSpeed;
+    if (jerk <= 0) { // v^2 = v0^2 + 2*a*steps
+      return min(fromSpeed2 + 2*accel*steps, maxSpeed2);
     }
-    else
-    {
-        //Serial.println("Writing Voltage Low");
-        digitalWrite(directionPins[pinIndex], LOW);
+
+    // No closed form for an S-curve; search for the fastest ramp that fits
+    float low = sqrt((float)(fromSpeed2));
+    float high = maxSpeed;
+    if (rampSteps(low, high, accel, jerk) <= steps) {return maxSpeed2;}
+    for (int i = 0; i < 16; i++) {
+      float mid = (low + high)/2;
+      if (rampSteps(sqrt((float)(fromSpeed2)), mid, accel, jerk) > steps) {high = mid;}
+      else {low = mid;}
+    }
+    return (unsigned long)(low*low);
+}
+
+long Scara::runMotor(int pinIndex, long steps, long maxSpeed, long accel) {
+    if (steps == 0) {return 0;} // Exit immediately if 0 steps required
+    if ((pinIndex != 0) && (pinIndex != 1)) { return 0;} // Exit immediately for bad pin index
+
+    // Queue the motion on the step timer for this motor
+    Axis &axis = (pinIndex == 0) ? rot : lin;
+    Profile profile;
+    makeProfile(profile, steps, maxSpeed, accel, jerkFor(pinIndex));
+    profile.brake2 = 2*brakeFor(pinIndex);
+#ifdef STEP_TRACE
+    stepTrace.begin();
+#endif
+    axis.push(profile);
+
+    // Wait for the step ISR to finish (or stop) the motion
+    long stepsLeft = axis.wait();
+#ifdef STEP_TRACE
+    stepTrace.report();
+#endif
+    track(pinIndex, steps - stepsLeft, axis.status());
+    if (powerCut) { // The motor may have run on after its driver let go, so the position is lost
+        errorCode = POWER_CUT;
+        known = false;
+    }
+    else if (axis.status() == -1) { // Paused
+        errorCode = -1;
+    }
+    else if (axis.status() > 0) { // Microswitch hit; 1 = "plus," 2 = "minus"
+        errorCode = 2*pinIndex + axis.status(); // Same codes as before: switch index + 1
+    }
+
+    return stepsLeft; // Signed number of steps remaining
+}
+
+void Scara::runMove(long &rotSteps, long &linSteps) {
+    // Single-motor motions run exactly as before
+    if (rotSteps == 0) {linSteps = intLinMotion(linSteps); return;}
+    if (linSteps == 0) {rotSteps = intRotMotion(rotSteps); return;}
+
+    // The motor with more steps is the master and sets the pace; the other follows it step for step
+    int masterIndex = (abs(linSteps) >= abs(rotSteps)) ? 1 : 0;
+    Axis &master = (masterIndex == 0) ? rot : lin;
+    Axis &slave = (masterIndex == 0) ? lin : rot;
+    long masterSteps = abs((masterIndex == 0) ? rotSteps : linSteps);
+    long slaveSteps = abs((masterIndex == 0) ? linSteps : rotSteps);
+    long maxSpeed = (masterIndex == 0) ? ROT_MAX_SPEED : LIN_MAX_SPEED;
+    long accel = (masterIndex == 0) ? ROT_ACCEL : LIN_ACCEL;
+    long slaveMaxSpeed = (masterIndex == 0) ? LIN_MAX_SPEED : ROT_MAX_SPEED;
+    long slaveAccel = (masterIndex == 0) ? LIN_ACCEL : ROT_ACCEL;
+
+    // The slave runs at slaveSteps/masterSteps of the master's speed; slow the master down if that
+    // would take the slave past its own speed or acceleration limit
+    maxSpeed = min(maxSpeed, slaveMaxSpeed*masterSteps/slaveSteps);
+    accel = min(accel, slaveAccel*masterSteps/slaveSteps);
+
+    // Jerk scales the same way; if either motor wants an S-curve, the move is one
+    long jerk = jerkFor(masterIndex);
+    long slaveJerk = jerkFor(1 - masterIndex);
+    if (slaveJerk > 0) {
+      long scaled = slaveJerk*masterSteps/slaveSteps;
+      jerk = (jerk > 0) ? min(jerk, scaled) : scaled;
+    }
+
+    // The pause brake too
+    long brake = min(brakeFor(masterIndex), brakeFor(1 - masterIndex)*masterSteps/slaveSteps);
+
+    Profile profile;
+    makeProfile(profile, (masterIndex == 0) ? rotSteps : linSteps, maxSpeed, accel, jerk);
+    profile.brake2 = 2*brake;
+    profile.slave = &slave;
+    profile.slaveDir = (masterIndex == 0) ? ((linSteps > 0) ? 1 : -1) : ((rotSteps > 0) ? 1 : -1);
+    profile.slaveSteps = slaveSteps;
+#ifdef STEP_TRACE
+    stepTrace.begin();
+#endif
+    master.push(profile);
+
+    // Wait for the master's ISR to finish (or stop) both motors
+    long masterLeft = master.wait();
+    long slaveLeft = slave.wait();
+#ifdef STEP_TRACE
+    stepTrace.report(); // Slave steps ride on the master's and are not timed separately
+#endif
+    if (powerCut) { // Position lost, as for runMotor()
+        errorCode = POWER_CUT;
+        known = false;
+    }
+    else if (master.status() == -1) { // Paused
+        errorCode = -1;
+    }
+    else if (master.status() == 3) { // Slave microswitch hit
+        errorCode = 2*(1 - masterIndex) + slave.status();
+    }
+    else if (master.status() > 0) { // Master microswitch hit
+        errorCode = 2*masterIndex + master.status();
+    }
+
+    track(0, rotSteps - ((masterIndex == 0) ? masterLeft : slaveLeft), rot.status());
+    track(1, linSteps - ((masterIndex == 0) ? slaveLeft : masterLeft), lin.status());
+    rotSteps = (masterIndex == 0) ? masterLeft : slaveLeft;
+    linSteps = (masterIndex == 0) ? slaveLeft : masterLeft;
+}
+
+int Scara::lookAhead(int first, int &leadIndex) {
+    // A chain starts with one motor moving on its own (the lead). It carries on through every following
+    // motion that moves it the same way, as long as the other motor has not joined in yet; the other
+    // motor may join in the last motion of the chain, or take over from the lead in it if the motion
+    // before has a blend. Reversals and hand-overs without a blend still stop, and so do combined
+    // motions, whose motors are tied together step for step.
+    if ((internalRot[first] == 0) == (internalLin[first] == 0)) {return first;}
+    leadIndex = (internalRot[first] == 0) ? 1 : 0;
+    const long *lead = (leadIndex == 0) ? internalRot : internalLin;
+    const long *other = (leadIndex == 0) ? internalLin : internalRot;
+
+    int last = first;
+    while ((last + 1 < motionCount) && (last + 1 - first < CHAIN_MAX) && (other[last] == 0)) {
+      long next = lead[last + 1];
+      if (next == 0) { // Hand-over to the other motor
+        if ((internalBlend[last] > 0) && (other[last + 1] != 0)) {last++;}
+        break;
+      }
+      if ((next > 0) != (lead[first] > 0)) {break;} // Lead turns round
+      last++;
+    }
+    return last;
+}
+
+void Scara::runChain(int first, int last, int leadIndex) {
+    Axis &lead = (leadIndex == 0) ? rot : lin;
+    Axis &other = (leadIndex == 0) ? lin : rot;
+    long *leadSteps = (leadIndex == 0) ? internalRot : internalLin;
+    long *otherSteps = (leadIndex == 0) ? internalLin : internalRot;
+    long maxSpeed = (leadIndex == 0) ? ROT_MAX_SPEED : LIN_MAX_SPEED;
+    long accel = (leadIndex == 0) ? ROT_ACCEL : LIN_ACCEL;
+    long jerk = jerkFor(leadIndex);
+    int otherIndex = 1 - leadIndex;
+
+#ifdef STEP_TRACE
+    stepTrace.begin();
+#endif
+    // The other motor has its own profile, from rest to rest, and sets off when the lead reaches it. With
+    // a blend on the motion before, that is as many steps before the junction; otherwise at the junction.
+    int leadLast = (leadSteps[last] == 0) ? last - 1 : last; // The lead may have handed over already
+    int cueAt = ((last > first) && (internalBlend[last - 1] > 0)) ? last - 1 : last;
+    if (otherSteps[last] != 0) {
+      Profile held;
+      makeProfile(held, otherSteps[last], (otherIndex == 0) ? ROT_MAX_SPEED : LIN_MAX_SPEED,
+          (otherIndex == 0) ? ROT_ACCEL : LIN_ACCEL, jerkFor(otherIndex));
+      held.brake2 = 2*brakeFor(otherIndex);
+      other.hold(held, lead);
     }
 
-    // Perform motion
-    // Acceleration
-    long stepCount = pulseTrain(pulsePins[pinIndex], switchIndex,
-            accelSteps, sqrt(accel), accel);
-    steps -= stepCount;
-    if (stepCount != accelSteps) { // If this happens, something is wrong
-        return dir*steps; // Signed number of steps remaining
+    // Junction speeds. The lead has the same limits all the way, so the fastest it can pass a junction
+    // is what it can reach accelerating from the start of the chain, or still stop from before its end.
+    // Each motion then ramps from the speed at one junction to the speed at the next.
+    long total = 0;
+    for (int k = first; k <= last; k++) {total += abs(leadSteps[k]);}
+    unsigned long junction2 = accel; // From rest, as for a single motion
+    long done = 0;
+    for (int k = first; k <= leadLast; k++) {
+      unsigned long start2 = junction2;
+      done += abs(leadSteps[k]);
+      junction2 = (k == leadLast) ? accel : reach2(accel, min(done, total - done), maxSpeed, accel, jerk);
+
+      Profile profile;
+      makeProfile(profile, leadSteps[k], maxSpeed, accel, jerk, start2, junction2);
+      profile.brake2 = 2*brakeFor(leadIndex);
+      profile.cue = ((k == cueAt) && (otherSteps[last] != 0));
+      profile.cueSteps = (k == last) ? abs(leadSteps[k]) : internalBlend[k];
+      lead.push(profile);
     }
-    // Constant Speed
-    stepCount = pulseTrain(pulsePins[pinIndex], switchIndex,
-            constSteps, maxSpeed, 0);
-    steps -= stepCount;
-    if (stepCount != constSteps) { // If this happens, something is wrong
-        return dir*steps; // Signed number of steps remaining
+
+    // Wait for both motors, then put back what is left of each motion. The lead's steps left cover
+    // the motion it stopped in and everything after it, so they belong to the end of the chain.
+    long leadLeft = lead.wait();
+    long otherLeft = other.wait();
+#ifdef STEP_TRACE
+    stepTrace.report();
+#endif
+    track(leadIndex, ((leadSteps[first] > 0) ? total : -total) - leadLeft, lead.status());
+    track(otherIndex, otherSteps[last] - otherLeft, other.status());
+    for (int k = last; k >= first; k--) {
+      long left = min(abs(leadLeft), abs(leadSteps[k]));
+      leadSteps[k] = (leadSteps[k] > 0) ? left : -left;
+      leadLeft -= (leadLeft > 0) ? left : -left;
     }
-    // Deceleration
-    stepCount = pulseTrain(pulsePins[pinIndex], switchIndex,
-            decelSteps, maxSpeed, -accel);
-    steps -= stepCount;
+    otherSteps[last] = otherLeft;
 
-    return (long)(dir)*steps; // Signed number of steps remaining
+    if (powerCut) { // Position lost, as for runMotor()
+        errorCode = POWER_CUT;
+        known = false;
+    }
+    else if ((lead.status() == -1) || (other.status() == -1)) { // Paused
+        errorCode = -1;
+    }
+    else if ((lead.status() > 0) && (lead.status() < 3)) { // Lead microswitch hit
+        errorCode = 2*leadIndex + lead.status();
+    }
+    else if ((other.status() > 0) && (other.status() < 3)) { // Other microswitch hit
+        errorCode = 2*otherIndex + other.status();
+    }
 }
 
 
@@ -229,43 +551,201 @@ long Scara::intLinMotion(long steps) {
 /*******************************************************************************
  * PUBLIC FUNCTIONS
  ******************************************************************************/
-float Scara::rotMotion(float distance_deg) {
-    // Convert "distance_deg" to a number of steps, set as "target steps"
-    long rotTarget = (long) (distance_deg*ROT_STEP_PER_DEG);
+long Scara::rotMotion(long centiDegrees) {
+    if (!waitForPower()) {return centiDegrees;}
+
+    // Convert "centiDegrees" to a number of steps, set as "target steps"
+    long rotTarget = toSteps(centiDegrees, ROT_STEP_PER_DEG);
 
     // Send instructions to the "runMotor" function
+    savePosition(false);
     long stepsComplete = runMotor(0, rotTarget,
            ROT_MAX_SPEED, ROT_ACCEL);
+    savePosition(known);
       // Get back number of steps actually completed and subtract from "target steps."
 
     // Return distance remaining from movement
-    return (float)(stepsComplete)/ROT_STEP_PER_DEG;
+    return toCenti(stepsComplete, ROT_STEP_PER_DEG);
 }
 
-float Scara::linMotion(float distance_cm) {
-    // Convert "distance_cm" to a number of steps, set as "target steps"
-    long linTarget = (long) (distance_cm*LIN_STEP_PER_CM);
+long Scara::linMotion(long centiCms) {
+    if (!waitForPower()) {return centiCms;}
+
+    // Convert "centiCms" to a number of steps, set as "target steps"
+    long linTarget = toSteps(centiCms, LIN_STEP_PER_CM);
 
     // Send instructions to the "runMotor" function
+    savePosition(false);
     long stepsComplete = runMotor(1, linTarget,
            LIN_MAX_SPEED, LIN_ACCEL);
+    savePosition(known);
       // Get back number of steps actually completed
-    return (float)(stepsComplete)/LIN_STEP_PER_CM;
+    return toCenti(stepsComplete, LIN_STEP_PER_CM);
+}
+
+// Queued motions come from a Sequence program. Each one moves the rotational arm by centiDegrees and the
+// linear arm by centiCms at the same time; a zero leaves that motor still. The queue only needs to be
+// as deep as the longest run of motions the arm can go through without stopping.
+//
+// A motion of one motor can have a blend: the next motion may set off the other motor once this one is
+// within centiBlend (degrees or cm, of this motion) of its end. The gripper cuts the corner by up to
+// that much, so only blend where that is clear. Combined motions cannot blend.
+bool Scara::addMotion(long centiDegrees, long centiCms, long centiBlend) {
+    if (motionCount == CHAIN_MAX) {return false;}
+    internalRot[motionCount] = toSteps(centiDegrees, ROT_STEP_PER_DEG);
+    internalLin[motionCount] = toSteps(centiCms, LIN_STEP_PER_CM);
+    internalBlend[motionCount] = 0;
+    if ((centiBlend > 0) && ((centiDegrees == 0) != (centiCms == 0))) {
+      internalBlend[motionCount] = toSteps(centiBlend, (centiDegrees != 0) ? ROT_STEP_PER_DEG : LIN_STEP_PER_CM);
+    }
+    motionCount++;
+    return true;
 }
 
-int Scara::runAll() {
+void Scara::clearMotions() {
+    motionCount = 0;
+}
+
+int Scara::motionsQueued() {
+    return motionCount;
+}
+
+int Scara::runNext() {
   errorCode = 0;
-  for(int i = 0; i < motionCount; i++) { // Loop through every internal motion
-    if (internalDistances[i] == 0) {continue;} // kick out if no distance left
+  if (motionCount == 0) {return 0;}
+  if (!waitForPower()) {return -1;}
+
+  // Look ahead for motions the arm can run into without stopping
+  savePosition(false);
+  int leadIndex = 0;
+  int last = lookAhead(0, leadIndex);
+  if (last == 0) {
+    runMove(internalRot[0], internalLin[0]); // Either motor, or both together
+  }
+  else {
+    runChain(0, last, leadIndex);
+  }
+  savePosition(known);
+
+  // Finished motions leave the queue; a paused one stays at the front with what is left of it
+  int done = 0;
+  while ((done < motionCount) && (internalRot[done] == 0) && (internalLin[done] == 0)) {done++;}
+  for (int i = done; i < motionCount; i++) {
+    internalRot[i - done] = internalRot[i];
+    internalLin[i - done] = internalLin[i];
+    internalBlend[i - done] = internalBlend[i];
+  }
+  motionCount -= done;
+  return errorCode;
+}
+
+int Scara::home() {
+  errorCode = 0;
+
+  // Sitting on both switches is home by definition, whatever was saved
+  if (homed()) {
+    rotPos = 0;
+    linPos = 0;
+    known = true;
+    savePosition(known);
+    return 0;
+  }
+  if (!waitForPower()) {return -1;}
+
+  // A home switch that is closed away from home means the arm was moved while it was switched off
+  if ((!FastPin<ROT_PLS_PIN>::read() && (rotPos != 0)) || (!FastPin<LIN_MIN_PIN>::read() && (linPos != 0))) {
+    known = false;
+  }
+  savePosition(false);
+  bool search = !known;
+
+  // Lift clear before swinging out, but only if the arm has to swing at all: a fixed lift from an
+  // unknown position, otherwise up to the height the load program swings at
+  long lift = 0;
+  if (!FastPin<ROT_PLS_PIN>::read()) {
+    lift = 0; // Already out
+  }
+  else if (search) {
+    lift = toSteps(HOME_LIFT, LIN_STEP_PER_CM);
+  }
+  else if (rotPos != 0) {
+    lift = max(0L, toSteps(HOME_TRAVEL, LIN_STEP_PER_CM) - linPos);
+  }
+  if (lift > 0) {
+    intLinMotion(lift);
+    if (errorCode == 3) {errorCode = 0;} // Hit the top; clear enough
+  }
 
-    if (internalMotors[i] == 0) { // Rotational motion
-      internalDistances[i] = intRotMotion(internalDistances[i]);
+  // From a known position, one motor at a time: swing out at that height to just short of the switch,
+  // then come down to the clearance height. The load program swings at that height, and at the
+  // clearance height between home and -23 deg, so the swing only goes where it has been.
+  long clear = toSteps(HOME_CLEAR, LIN_STEP_PER_CM);
+  long swing = -rotPos - toSteps(ROT_BACKOFF, ROT_STEP_PER_DEG);
+  if ((errorCode == 0) && !search && (swing > 0)) {
+    intRotMotion(swing);
+    if (errorCode == 1) { // On the home switch early, so not where it was saved
+      known = false;
+      return home();
     }
-    else {
-      internalDistances[i] = intLinMotion(internalDistances[i]);
+  }
+  if ((errorCode == 0) && !search && (swing > 0) && (linPos > clear)) {
+    intLinMotion(clear - linPos);
+    if (errorCode == 4) { // Same for the linear arm
+      known = false;
+      return home();
     }
-    if (errorCode != 0) {break;}
   }
 
+  // Swing out, then lower
+  int result = errorCode;
+  if (result == 0) {result = homeAxis(0, search);}
+  if (result == 0) {result = homeAxis(1, search);}
+  if (!search && ((result == 5) || (result == 6))) { // The arm was not where it was saved; start again with a full search
+    known = false;
+    return home();
+  }
+
+  // A pause brakes to a stop with every step counted, so the position is still good; a switch where
+  // it should not be, a switch not found or a power cut (which clears "known" itself) is not
+  if (result != -1) {known = (result == 0);}
+  errorCode = result;
+  savePosition(known);
   return errorCode;
 }
+
+int Scara::homeAxis(int pinIndex, bool search) {
+  int dir = (pinIndex == 0) ? 1 : -1;        // Rotational home is "plus," linear home is "minus"
+  int homeCode = 2*pinIndex + ((dir > 0) ? 1 : 2); // Error code when the home switch stops a motion
+  long &pos = (pinIndex == 0) ? rotPos : linPos;
+  long backoff = (pinIndex == 0) ? toSteps(ROT_BACKOFF, ROT_STEP_PER_DEG) : toSteps(LIN_BACKOFF, LIN_STEP_PER_CM);
+  long travel = (pinIndex == 0) ? toSteps(ROT_TRAVEL, ROT_STEP_PER_DEG) : toSteps(LIN_TRAVEL, LIN_STEP_PER_CM);
+  long maxSpeed = (pinIndex == 0) ? ROT_MAX_SPEED : LIN_MAX_SPEED;
+  long accel = (pinIndex == 0) ? ROT_ACCEL : LIN_ACCEL;
+  long creepSpeed = (pinIndex == 0) ? ROT_CREEP_SPEED : LIN_CREEP_SPEED;
+
+  // Fast approach: from a known position, straight to a back-off short of the switch; otherwise
+  // sweep the whole travel and let the switch stop the motor
+  errorCode = 0;
+  long fast = search ? dir*travel : (-pos - dir*backoff);
+  if (fast*dir > 0) {runMotor(pinIndex, fast, maxSpeed, accel);}
+  if (errorCode == -1) {return -1;}
+  if ((errorCode != 0) && (errorCode != homeCode)) {return errorCode;} // Wrong switch
+  if ((errorCode == 0) && search) {return 5 + pinIndex;} // Swept the whole travel without finding it
+
+  // If the switch stopped a fast motor, come back off it
+  if (errorCode == homeCode) {
+    errorCode = 0;
+    runMotor(pinIndex, -dir*backoff, maxSpeed, accel);
+    if (errorCode != 0) {return errorCode;}
+  }
+
+  // Slow approach onto the switch, which zeroes the position
+  runMotor(pinIndex, dir*2*backoff, creepSpeed, accel);
+  if (errorCode == -1) {return -1;}
+  if (errorCode != homeCode) {
+    return (errorCode != 0) ? errorCode : 5 + pinIndex;
+  }
+
+  errorCode = 0;
+  return 0;
+}
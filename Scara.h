@@ -2,64 +2,137 @@
 #define SCARA_H
 
 #include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+#include <EEPROM.h>
+#include "Axis.h"
+#include "FastPin.h"
+#include "EepromMap.h"
+
+// Fixed-point distance: hundredths of a cm or degree. Constant arguments are rounded at compile time.
+#define CENTI(x) ((long)((x)*100.0 + (((x) < 0) ? -0.5 : 0.5)))
 
 class Scara {
 
     public:
         Scara(volatile bool *pFlag); // Constructor
-        void setStates(int moCount, float floatDistances[], bool intMotors[]); // Constructor using internal states
-        void enable();                       // Safely enable the stepper motors
-        void disable();                      // Safely disable the stepper motors
-        float linMotion(float distance_cm); // Move the vertical arm by a distance in cm
-        float rotMotion(float distance_deg);   // Move the rotational arm by a distance in deg
-        int runAll();                         // Run any internal motions
+        void enable();                       // Safely enable the stepper motors (power() finishes it a second later)
+        void disable();                      // Safely disable the stepper motors (power() finishes it a second later)
+        void power();                        // Scheduler task: finishes enable() and disable() once the relay has settled
+        bool powered();                      // enable() has finished and the drivers are on
+        uint8_t selfTest();                  // Boot check of the switches and power outputs; faults found (bits below)
+        long linMotion(long centiCms);       // Move the vertical arm by CENTI(cm); returns the distance left, the same way
+        long rotMotion(long centiDegrees);   // Move the rotational arm by CENTI(deg); returns the distance left, the same way
+        bool addMotion(long centiDegrees, long centiCms, long centiBlend = 0); // Queue a motion; false if the queue is full
+        void clearMotions();                  // Drop every queued motion
+        int motionsQueued();                  // Motions queued and not yet finished
+        int runNext();                        // Run queued motions up to the next stop and drop the finished ones
+        int home();                           // Bring the arm home; 0 = done, -1 = paused, 1-4 = other switch hit,
+                                              // 5/6 = rotational/linear home switch not found, 8 = power cut
         bool homed();                         // Check if arm at home location
+        void rotISR() { rot.isr(); }          // Timer3 compare-match handler (rotational steps)
+        void linISR() { lin.isr(); }          // Timer4 compare-match handler (linear steps)
+        bool moving();                        // True while either motor has steps to run
+        unsigned long brakeTime();            // Longest a pause can take to brake the arm to a stop (ms)
+        void cutPower();                      // Drivers and relay off, pulses stopped; only call from an ISR
+
+        static const int POWER_CUT = 8;       // Error code: the motors lost power part way through a motion
+
+        // selfTest() faults
+        static const uint8_t ROT_SWITCHES = 0x01; // Both rotational microswitches closed at once
+        static const uint8_t LIN_SWITCHES = 0x02; // Both linear microswitches closed at once
+        static const uint8_t MOTOR_POWER = 0x04;  // Relay or driver enable pin stuck, or the drivers not on
 
 
     private:
         // Hardware/other constants
-        const float M = 1000000;      // The number "1 million"
+        static const int RELAY_PWR_PIN = 28; // OUTPUT, Relay "enable" pin
 
-        const int RELAY_PWR_PIN = 28; // OUTPUT, Relay "enable" pin
+        static const int ROT_ENA_PIN = 6;    // OUTPUT, Rotational motor "enable" pin
+        static const int ROT_DIR_PIN = 7;    // OUTPUT, Rotational motor "direction" pin
+        static const int ROT_PUL_PIN = 8;    // OUTPUT, Rotational motor "pulse" pin
 
-        const int ROT_ENA_PIN = 6;    // OUTPUT, Rotational motor "enable" pin
-        const int ROT_DIR_PIN = 7;    // OUTPUT, Rotational motor "direction" pin
-        const int ROT_PUL_PIN = 8;    // OUTPUT, Rotational motor "pulse" pin
+        static const int ROT_PLS_PIN = 30;   // INPUT, Rotational motor "plus" microswitch
+        static const int ROT_MIN_PIN = 31;   // INPUT, Rotational motor "minus" microswitch
 
-        const int ROT_PLS_PIN = 30;   // INPUT, Rotational motor "plus" microswitch
-        const int ROT_MIN_PIN = 31;   // INPUT, Rotational motor "minus" microswitch
+        static const int LIN_ENA_PIN = 10;   // OUTPUT, Linear motor "enable" pin
+        static const int LIN_DIR_PIN = 11;   // OUTPUT, Linear motor "direction" pin
+        static const int LIN_PUL_PIN = 12;   // OUTPUT, Linear motor "pulse" pin
 
-        const int LIN_ENA_PIN = 10;   // OUTPUT, Linear motor "enable" pin
-        const int LIN_DIR_PIN = 11;   // OUTPUT, Linear motor "direction" pin
-        const int LIN_PUL_PIN = 12;   // OUTPUT, Linear motor "pulse" pin
+        static const int LIN_PLS_PIN = 33;   // INPUT, Linear motor "plus" microswitch
+        static const int LIN_MIN_PIN = 32;   // INPUT, Linear motor "minus" microswitch
 
-        const int LIN_PLS_PIN = 33;   // INPUT, Linear motor "plus" microswitch
-        const int LIN_MIN_PIN = 32;   // INPUT, Linear motor "minus" microswitch
+        // Motion profile shapes. A trapezoid switches the acceleration straight on and off; an S-curve ramps
+        // it at the jerk rate, which takes the shock out of starting and stopping. Braking for a pause is
+        // never jerk limited (see the stop rates below).
+        static const int TRAPEZOID = 0;
+        static const int S_CURVE = 1;
 
         // ALL STEPPER MOTOR VALUES MUST BE LONG (32,767 steps vs 2.14 million)
-        const long LIN_STEP_PER_CM = 5328;  // Linear motor steps per cm at 1/128 microsteps
-        const long ROT_STEP_PER_DEG = 71;   // Rotational motor steps per degress at 1/128 microsteps
-        // const long ROT_MAX_SPEED = 1800;    // Rotational Stepper motor maximum speed; steps per second
-        const long ROT_MAX_SPEED = 1200;
-        const long LIN_MAX_SPEED = 4800;    // Linear motor maximum speed; microsteps per second
-        const long ROT_ACCEL = 150;         // Rotational motor acceleration rate; steps per second^2
-        const long LIN_ACCEL = 720;         // Linear motor acceleration rate; steps per second^2
+        static const long LIN_STEP_PER_CM = 5328;  // Linear motor steps per cm at 1/128 microsteps
+        static const long ROT_STEP_PER_DEG = 71;   // Rotational motor steps per degress at 1/128 microsteps
+        static const long ROT_MAX_SPEED = 1200;    // Rotational Stepper motor maximum speed; steps per second (missed
+                                                   // steps at 1800 as a trapezoid; not yet tried on the arm as an S-curve)
+        static const long LIN_MAX_SPEED = 4800;    // Linear motor maximum speed; microsteps per second
+        static const long ROT_ACCEL = 150;         // Rotational motor acceleration rate; steps per second^2
+        static const long LIN_ACCEL = 720;         // Linear motor acceleration rate; steps per second^2
+        static const int ROT_PROFILE = S_CURVE;    // Rotational motor profile shape
+        static const int LIN_PROFILE = TRAPEZOID;  // Linear motor profile shape
+        static const long ROT_JERK = 300;          // Rotational motor jerk (S_CURVE only); steps per second^3
+        static const long LIN_JERK = 2880;         // Linear motor jerk (S_CURVE only); steps per second^3
+        // Pause braking. The old pulse loop stopped both motors dead from full speed, a few full steps per
+        // second at 1/128 microsteps, so a quarter of a second from top speed is well within what they hold.
+        static const long ROT_STOP_DECEL = 4800;   // Rotational motor braking rate for a pause; steps per second^2
+        static const long LIN_STOP_DECEL = 19200;  // Linear motor braking rate for a pause; steps per second^2
+        static const int CHAIN_MAX = 3;     // Most motions run without stopping; an Axis queues 3 at once
+        // Homing. Home is the rotational "plus" and linear "minus" microswitches; positions count from there.
+        static const long HOME_LIFT = CENTI(15);   // Lift before swinging out from an unknown position (cm)
+        static const long HOME_TRAVEL = CENTI(20); // Height the load program swings at; homing from a known position swings there too (cm)
+        static const long HOME_CLEAR = CENTI(5);   // Height the arm comes down to before the slow approach to the switch (cm)
+        static const long ROT_TRAVEL = CENTI(360); // Longest rotational sweep for the switch (deg)
+        static const long LIN_TRAVEL = CENTI(45);  // Longest linear sweep for the switch (cm)
+        static const long ROT_BACKOFF = CENTI(1);  // Back-off from the switch before the slow approach (deg)
+        static const long LIN_BACKOFF = CENTI(0.25); // Back-off from the switch before the slow approach (cm)
+        static const long ROT_CREEP_SPEED = 60;    // Slow approach onto the switch; steps per second
+        static const long LIN_CREEP_SPEED = 800;   // Slow approach onto the switch; steps per second
+        static const uint8_t POSITION_VERSION = 1; // Change when the saved position layout changes
+        static const unsigned long POWER_SETTLE = 1000; // Relay settling time between it and the drivers (ms)
         int errorCode = 0;                  // Internal error code, 0 = nominal
         volatile bool *pauseFlag;            // Reference to globa pause flag
 
-        int directionPins[2];
-        int pulsePins[2];
-        int switchPins[4];
+        // Timer-driven step generators; must be declared after the pin constants above
+        Axis rot;                           // Rotational motor, stepped from Timer3
+        Axis lin;                           // Linear motor, stepped from Timer4
 
         // Internal state trackers
-        int motionCount;                    // Number of internal motions
-        long internalDistances[16];         // Array of distances to target position (max 16)
-        bool internalMotors[16];            // Array of motor integers; [0] = rotational, [1] = linear (max 16)
+        long rotPos;                        // Rotational position; steps from home (inboard is negative)
+        long linPos;                        // Linear position; steps above home
+        bool known;                         // Position can be trusted (homed since it was last lost)
+        volatile bool powerCut;             // cutPower() stopped the motors; cleared by enable()
+        enum {POWER_OFF, POWERING_UP, POWER_ON, POWERING_DOWN};
+        volatile uint8_t powerState;        // Where enable()/disable() have got to; cutPower() sets POWER_OFF
+        unsigned long powerSince;           // millis() when the relay or drivers were last switched
+        int motionCount;                    // Number of queued motions
+        long internalRot[CHAIN_MAX];        // Rotational steps left in each queued motion
+        long internalLin[CHAIN_MAX];        // Linear steps left in each queued motion
+        long internalBlend[CHAIN_MAX];      // Steps before the end of each motion the next one may start
 
         // Private functions
+        bool waitForPower();                // Wait for enable() to finish; false if paused meanwhile
         long runMotor(int pinIndex, long steps, long maxSpeed, long accel); // Run a stepper motor
-        long pulseTrain(int pin, int switchIndex, long steps, long startSpeed, long accelRate); // Send a train of pulses
-        void pulse(int pin, int period);    // Send a single pulse of a given period
+        void runMove(long &rotSteps, long &linSteps); // Run both motors together; leaves steps remaining
+        int lookAhead(int first, int &leadIndex); // Last motion that "first" runs into without stopping
+        void runChain(int first, int last, int leadIndex); // Run motions first..last without stopping the lead
+        void makeProfile(Profile &profile, long steps, long maxSpeed, long accel, long jerk); // Fill in a motion profile
+        void makeProfile(Profile &profile, long steps, long maxSpeed, long accel, long jerk,
+                         unsigned long startSpeed2, unsigned long endSpeed2); // Same, between two speeds
+        long jerkFor(int pinIndex);         // Jerk limit of a motor; 0 for a trapezoid
+        long brakeFor(int pinIndex);        // Pause braking rate of a motor
+        float rampSteps(float fromSpeed, float toSpeed, long accel, long jerk); // Steps to change speed
+        unsigned long reach2(unsigned long fromSpeed2, long steps, long maxSpeed, long accel, long jerk); // Fastest speed^2 within "steps"
+        long toSteps(long centiDistance, long stepsPerUnit); // Convert a fixed-point distance to steps
+        long toCenti(long steps, long stepsPerUnit); // Convert steps to a fixed-point distance
+        void track(int pinIndex, long moved, int status); // Add a finished motion to the position
+        void savePosition(bool valid);      // Save the position to EEPROM; "false" marks it stale
+        int homeAxis(int pinIndex, bool search); // Drive one motor onto its home switch and zero it
         long intLinMotion(long steps);      // Move the vertical arm by a distance in steps
         long intRotMotion(long steps);      // Move the rotational arm by a distance in steps
 };
@@ -0,0 +1,149 @@
+// Task scheduler on the 1 ms tick; see Scheduler.h. Interrupt tasks are timed with Timer2's own counter,
+// which the tick clears at every compare match, so timing them costs a register read each rather than
+// a call to micros(). Background tasks run in the foreground and are timed with micros().
+
+#include "Scheduler.h"
+
+// Constructor: Provide default values
+Scheduler::Scheduler() {
+    count = 0;
+    running = false;
+    longestTick = 0;
+    overruns = 0;
+}
+
+bool Scheduler::anyDue() {
+    for (uint8_t i = 0; i < count; i++) {
+      if (tasks[i].due) {return true;}
+    }
+    return false;
+}
+
+void Scheduler::account(Task &task, unsigned long us) {
+    task.runs++;
+    task.busy += us;
+    if (us > task.longest) {task.longest = min(us, 65535UL);}
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ ******************************************************************************/
+void Scheduler::begin() {
+    noInterrupts();
+    TCCR2A = (1 << WGM21);    // CTC mode
+    TCCR2B = (1 << CS22);     // 64 prescaler
+    TCNT2  = 0;
+    OCR2A = 249;              // compare match register 16MHz/64/1kHz
+    TIMSK2 |= (1 << OCIE2A);  // enable timer compare interrupt
+    interrupts();
+}
+
+bool Scheduler::add(void (*task)(void), uint16_t period, uint8_t kind, const __FlashStringHelper *name) {
+    if ((count == MAX_TASKS) || (period == 0)) {return false;}
+    Task &t = tasks[count];
+    t.run = task;
+    t.name = name;
+    t.period = period;
+    t.countdown = period;
+    t.kind = kind;
+    t.due = false;
+    t.dueAt = 0;
+    t.runs = 0;
+    t.busy = 0;
+    t.longest = 0;
+    t.late = 0;
+    t.missed = 0;
+
+    uint8_t oldSREG = SREG; cli();
+    count++; // Only once it is filled in; the tick may be running already
+    SREG = oldSREG;
+    return true;
+}
+
+void Scheduler::tick() {
+    for (uint8_t i = 0; i < count; i++) {
+      Task &t = tasks[i];
+      if (--t.countdown != 0) {continue;}
+      t.countdown = t.period;
+
+      if (t.kind == BACKGROUND) {
+        if (t.due) { // Still waiting from last time
+          if (t.missed < 65535) {t.missed++;}
+        }
+        else {
+          t.dueAt = micros();
+          t.due = true;
+        }
+        continue;
+      }
+
+      uint8_t start = TCNT2;
+      t.run();
+      account(t, (uint8_t)(TCNT2 - start)*US_PER_COUNT);
+    }
+
+    // The counter has run since the compare match that started this tick, unless it has come round again
+    if (TIFR2 & (1 << OCF2A)) {
+      if (overruns < 65535) {overruns++;}
+    }
+    else {
+      uint16_t took = TCNT2*US_PER_COUNT;
+      if (took > longestTick) {longestTick = took;}
+    }
+}
+
+void Scheduler::run() {
+    if (running) {return;} // A task is waiting on something and let the core call yield()
+    running = true;
+    bool ran = false;
+    for (uint8_t i = 0; i < count; i++) {
+      Task &t = tasks[i];
+      if (!t.due) {continue;}
+      unsigned long start = micros();
+      unsigned long late = start - t.dueAt; // The tick leaves dueAt alone while the task is due
+      t.due = false;
+      t.run();
+      account(t, micros() - start);
+      if (late > t.late) {t.late = late;}
+      ran = true;
+    }
+    running = false;
+    if (ran) {return;}
+
+    // Nothing to do until the next interrupt. "sei" only takes effect after the instruction that follows
+    // it, so a tick that comes in after the check wakes the sleep instead of being slept through.
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+    if (!anyDue()) {
+      sleep_enable();
+      sei();
+      sleep_cpu();
+      sleep_disable();
+    }
+    sei();
+}
+
+void Scheduler::report() {
+    Serial.println(F("Tasks: runs, mean/longest run (us), worst start delay (us), periods missed"));
+    for (uint8_t i = 0; i < count; i++) {
+      uint8_t oldSREG = SREG; cli();
+      Task t = tasks[i]; // The tick updates the interrupt tasks' timings
+      SREG = oldSREG;
+
+      Serial.print(F("  ")); Serial.print(t.name);
+      Serial.print(F(": ")); Serial.print(t.runs);
+      Serial.print(F(", ")); Serial.print((t.runs > 0) ? t.busy/t.runs : 0);
+      Serial.print('/'); Serial.print(t.longest);
+      if (t.kind == BACKGROUND) {
+        Serial.print(F(", ")); Serial.print(t.late);
+        Serial.print(F(", ")); Serial.print(t.missed);
+      }
+      Serial.println();
+    }
+    uint8_t oldSREG = SREG; cli();
+    uint16_t longest = longestTick;
+    uint16_t over = overruns;
+    SREG = oldSREG;
+    Serial.print(F("  tick: longest ")); Serial.print(longest);
+    Serial.print(F(" us, ")); Serial.print(over); Serial.println(F(" overruns"));
+}
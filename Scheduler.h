@@ -0,0 +1,67 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+#include <avr/sleep.h>
+
+// A small cooperative scheduler on a 1 ms tick from Timer2. Each subsystem's periodic job is a task in
+// a fixed table, added once in setup() with the period it needs. A task is one of two kinds:
+//
+//   INTERRUPT   runs inside the tick interrupt, on time whatever the foreground is doing. For short
+//               jobs with a deadline: the pause stop, cylinder timing, the light and horn patterns.
+//   BACKGROUND  the tick only marks it due; run() runs it. The main loop, the idle loops and yield()
+//               (so every wait in the motion and cylinder code) call run(). For the slower jobs that
+//               only need doing soon: the LCD, the serial link, stepper power sequencing.
+//
+// When no background task is due, run() puts the CPU into idle sleep until the next interrupt. The
+// timers, the serial port and the pin interrupts all keep running, so nothing that is waited on is
+// missed.
+//
+// report() prints how often each task ran, its mean and longest run time and, for a background task,
+// how late it started at worst and how many periods came round before it got to run. For the tick
+// itself it prints the longest one and how many ran into the next tick.
+class Scheduler {
+
+    public:
+        // Kinds of task
+        static const uint8_t INTERRUPT = 0;
+        static const uint8_t BACKGROUND = 1;
+
+        Scheduler(); // Constructor
+        void begin();                       // Start the tick
+        bool add(void (*task)(void), uint16_t period, uint8_t kind, const __FlashStringHelper *name);
+                                            // Add a task that runs every "period" ms; false if the table is full
+        void tick();                        // Only call from the Timer2 compare ISR
+        void run();                         // Run the background tasks that are due, or sleep if there are none
+        void report();                      // Print the task timings to the serial port
+
+    private:
+        static const uint8_t MAX_TASKS = 6; // Size of the task table; raise it to add a task
+        static const unsigned int US_PER_COUNT = 4; // Timer2 counts at 16 MHz/64
+
+        struct Task {
+            void (*run)(void);
+            const __FlashStringHelper *name;
+            uint16_t period;                // ms
+            uint16_t countdown;             // Ticks until it is next due
+            uint8_t kind;                   // INTERRUPT or BACKGROUND
+            volatile bool due;              // Background task waiting for run()
+            unsigned long dueAt;            // micros() when it came due (background)
+            unsigned long runs;             // Times it has run
+            unsigned long busy;             // Time spent running it (us)
+            uint16_t longest;               // Longest run (us)
+            unsigned long late;             // Longest wait from due to running (us, background)
+            uint16_t missed;                // Periods that came round while it was still due (background)
+        };
+
+        Task tasks[MAX_TASKS];
+        uint8_t count;                      // Tasks in the table
+        bool running;                       // run() is part way through; a task that waits does not re-enter it
+        uint16_t longestTick;               // Longest tick that finished in time (us)
+        uint16_t overruns;                  // Ticks still running when the next one came due
+
+        bool anyDue();                      // A background task is waiting
+        void account(Task &task, unsigned long us); // Add one run to a task's timings
+};
+
+#endif
@@ -0,0 +1,164 @@
+// Runs the AGSE's operation programs (see Sequence.h) out of flash. Arm motions are handed to Scara a
+// few at a time: the interpreter keeps the arm's motion queue topped up from the program, so Scara can
+// still look ahead and run through junctions, but never holds more than CHAIN_MAX motions in SRAM.
+// Cylinder motions and LCD messages go straight to Linear and Output.
+
+#include "Sequence.h"
+
+// Bytes in each instruction (opcode and operands), by opcode; in flash with the programs
+const uint8_t Sequence::LENGTHS[] PROGMEM = {
+    1, // END
+    3, // ROT
+    3, // LIN
+    5, // MOVE
+    2, // START
+    2, // RUN
+    2, // WAIT
+    2, // TOP
+    2, // BOTTOM
+    1, // CHECKPOINT
+    1, // HOME
+    3, // BLEND
+};
+
+// Constructor: Provide default values
+Sequence::Sequence(Scara *pScara, Linear *pLin, Output *pOut, const char * const *pMessages,
+                   Profiler *pProfiler, volatile bool *pFlag) {
+    scara = pScara;
+    lin = pLin;
+    out = pOut;
+    messages = pMessages;
+    profiler = pProfiler;
+    pauseFlag = pFlag; // Set global pause flag reference
+    resume = NULL;
+    window = NULL;
+    fill = NULL;
+    started = false;
+}
+
+uint8_t Sequence::length(uint8_t op) {
+    return pgm_read_byte(&LENGTHS[op]);
+}
+
+int16_t Sequence::distance(const uint8_t *operand) {
+    return (int16_t)(pgm_read_byte(operand) | (pgm_read_byte(operand + 1) << 8));
+}
+
+const uint8_t *Sequence::after(const uint8_t *instruction) {
+    instruction += length(pgm_read_byte(instruction));
+    if (pgm_read_byte(instruction) == BLEND) {instruction += length(BLEND);}
+    return instruction;
+}
+
+bool Sequence::queueMotion(const uint8_t *instruction) {
+    uint8_t op = pgm_read_byte(instruction);
+    long first = distance(instruction + 1);
+    const uint8_t *next = instruction + length(op);
+    long blend = (pgm_read_byte(next) == BLEND) ? distance(next + 1) : 0;
+    if (op == ROT) {return scara->addMotion(first, 0, blend);}
+    if (op == LIN) {return scara->addMotion(0, first, blend);}
+    return scara->addMotion(first, distance(instruction + 3));
+}
+
+int Sequence::runMotions(const uint8_t *&pc) {
+    // A block that was cut short is still queued on the arm, with the steps left in each motion
+    if ((pc != window) || (scara->motionsQueued() == 0)) {
+      scara->clearMotions();
+      window = pc;
+      fill = pc;
+    }
+
+    while (true) {
+      // Keep the queue full so the arm can see which motions it can run through without stopping
+      uint8_t op = pgm_read_byte(fill);
+      while (((op == ROT) || (op == LIN) || (op == MOVE)) && queueMotion(fill)) {
+        fill = after(fill);
+        op = pgm_read_byte(fill);
+      }
+      if (scara->motionsQueued() == 0) {break;}
+
+      int before = scara->motionsQueued();
+      int errState = scara->runNext();
+      int finished = before - scara->motionsQueued();
+      for (int i = 0; i < finished; i++) {window = after(window);}
+      if (finished > 0) {resume = window;} // The arm cannot take a motion back, so never run it again
+      if (errState != 0) {return errState;}
+    }
+
+    pc = fill;
+    window = NULL;
+    return 0;
+}
+
+int Sequence::interpret() {
+    const uint8_t *pc = resume;
+    while (true) {
+      if (*pauseFlag) {return -1;}
+      uint8_t op = pgm_read_byte(pc);
+      uint8_t operand = pgm_read_byte(pc + 1);
+      int cylinder = operand & 0x0F;
+      int dir = (operand & 0x10) ? Linear::EXTEND : Linear::RETRACT;
+
+      switch (op) {
+        case END:
+          resume = pc; // Stay finished until the program is loaded again
+          return 0;
+        case ROT:
+        case LIN:
+        case MOVE: {
+          int errState = runMotions(pc); // Moves "pc" past the whole block
+          if (errState != 0) {return errState;}
+          continue;
+        }
+        case START:
+        case RUN:
+          // A refused motion never ran, and wait() would only give back the state of the one before
+          if (lin->start(cylinder, dir) == Linear::REFUSED) {return REFUSED;}
+          if ((op == RUN) && (lin->wait(cylinder) == Linear::PAUSED)) {return -1;}
+          break;
+        case WAIT:
+          if (lin->wait(operand) == Linear::PAUSED) {return -1;}
+          break;
+        case TOP:
+          out->printTop((const __FlashStringHelper *)pgm_read_ptr(&messages[operand]));
+          profiler->enter(Profiler::MESSAGE + operand);
+          break;
+        case BOTTOM:
+          out->printBottom((const __FlashStringHelper *)pgm_read_ptr(&messages[operand]));
+          break;
+        case CHECKPOINT:
+          resume = pc + length(op);
+          break;
+        case BLEND: // Only means something straight after a motion, where runMotions() reads it
+          break;
+        case HOME: {
+          int homeState = scara->home();
+          if (homeState != 0) {return homeState;}
+          break;
+        }
+        default:
+          return BAD_PROGRAM;
+      }
+      pc += length(op);
+    }
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ ******************************************************************************/
+void Sequence::load(const uint8_t *pProgram) {
+    resume = pProgram;
+    window = NULL;
+    started = false;
+}
+
+int Sequence::run() {
+    if (!started) {profiler->begin(); started = true;}
+    else {profiler->resume();} // Nothing to resume once the run has finished
+
+    int result = interpret();
+    if (result == -1) {profiler->pause();}
+    else if (result == 0) {profiler->finish();}
+    else {profiler->abandon();}
+    return result;
+}
@@ -0,0 +1,95 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+#include "Scara.h"
+#include "Linear.h"
+#include "Output.h"
+#include "Profiler.h"
+
+// Interpreter for operation programs kept in flash. A program is a string of one-byte opcodes, each
+// followed by its operands, written with the SEQ_ macros below into a PROGMEM array and ended with
+// SEQ_END. It is read straight out of flash one instruction at a time, so it can be any length and
+// costs no SRAM.
+//
+// Pausing: run() returns -1 and the next call picks up again from the last checkpoint, so every
+// instruction after it runs again. A cylinder motion that reached its microswitch stops again at
+// once, so it is safe to repeat. The door's extend has no microswitch: repeated, it drives the closed
+// door for its whole time again, so put a checkpoint straight after it. Start a cylinder after the
+// checkpoint that covers it. Arm motions are never repeated: a
+// finished one counts as a checkpoint, and one that was cut short carries on with the steps it has left.
+//
+// Timing: each run of the program, from load() to the end, is timed phase by phase in a Profiler. The
+// program's TOP messages mark the phases.
+class Sequence {
+
+    public:
+        Sequence(Scara *pScara, Linear *pLin, Output *pOut, const char * const *pMessages,
+                 Profiler *pProfiler, volatile bool *pFlag); // Constructor; "pMessages" is a PROGMEM
+                                            // table of LCD messages
+        void load(const uint8_t *pProgram); // Start a PROGMEM program from the beginning
+        int run();                          // Run the program; 0 = finished, -1 = paused, 1-6 and 8 =
+                                            // Scara error (see Scara::home()), 7 = bad instruction,
+                                            // 9 = cylinder motion refused
+
+        // Opcodes. Operands: distances are signed 16-bit hundredths of a degree or cm (+/-327.67), low byte
+        // first; a cylinder byte is the cylinder number, plus 0x10 for an extend; a message is an index into
+        // the message table.
+        static const uint8_t END = 0;        // Stop; the program is finished
+        static const uint8_t ROT = 1;        // distance: move the rotational arm
+        static const uint8_t LIN = 2;        // distance: move the linear arm
+        static const uint8_t MOVE = 3;       // distance, distance: move both arms together
+        static const uint8_t START = 4;      // cylinder: start a cylinder motion and carry on
+        static const uint8_t RUN = 5;        // cylinder: run a cylinder motion to its microswitch
+        static const uint8_t WAIT = 6;       // cylinder number: wait for a started motion's microswitch
+        static const uint8_t TOP = 7;        // message: show a message on the top LCD line
+        static const uint8_t BOTTOM = 8;     // message: show a message on the bottom LCD line
+        static const uint8_t CHECKPOINT = 9; // Where to pick up again after a pause
+        static const uint8_t HOME = 10;      // Bring the arm home (Scara::home())
+        static const uint8_t BLEND = 11;     // distance: straight after a ROT or LIN, let the next motion
+                                             // start this far before its end (see Scara::addMotion())
+
+        static const int BAD_PROGRAM = 7;    // run() error for an opcode it does not know
+        static const int REFUSED = 9;        // run() error for a cylinder motion an interlock would not start
+
+    private:
+        static const uint8_t LENGTHS[] PROGMEM; // Bytes in each instruction, by opcode
+
+        Scara *scara;
+        Linear *lin;
+        Output *out;
+        const char * const *messages;       // PROGMEM table of PROGMEM strings
+        Profiler *profiler;
+        volatile bool *pauseFlag;           // Reference to global pause flag
+
+        const uint8_t *resume;              // Where run() starts: the last checkpoint or finished motion
+        const uint8_t *window;              // First motion queued on the arm (NULL if none)
+        const uint8_t *fill;                // Next motion to queue on the arm
+        bool started;                       // run() has been called since load()
+
+        static uint8_t length(uint8_t op);  // Bytes in an instruction, from LENGTHS
+        int interpret();                    // Run the program from "resume"; returns as run() does
+        int runMotions(const uint8_t *&pc); // Run the block of arm motions at "pc" and move past it
+        bool queueMotion(const uint8_t *instruction); // Queue one arm motion; false if the queue is full
+        const uint8_t *after(const uint8_t *instruction); // Instruction after a motion and its blend
+        int16_t distance(const uint8_t *operand); // Read a distance operand
+};
+
+// Program instructions; see the opcodes above. Distances are in degrees and cm, as for CENTI().
+#define SEQ_DISTANCE(x) (uint8_t)(CENTI(x) & 0xFF), (uint8_t)((CENTI(x) >> 8) & 0xFF)
+#define SEQ_CYLINDER(cylinder, dir) (uint8_t)((cylinder) | (((dir) > 0) ? 0x10 : 0))
+
+#define SEQ_END Sequence::END
+#define SEQ_ROT(deg) Sequence::ROT, SEQ_DISTANCE(deg)
+#define SEQ_LIN(cm) Sequence::LIN, SEQ_DISTANCE(cm)
+#define SEQ_MOVE(deg, cm) Sequence::MOVE, SEQ_DISTANCE(deg), SEQ_DISTANCE(cm)
+#define SEQ_START(cylinder, dir) Sequence::START, SEQ_CYLINDER(cylinder, dir)
+#define SEQ_RUN(cylinder, dir) Sequence::RUN, SEQ_CYLINDER(cylinder, dir)
+#define SEQ_WAIT(cylinder) Sequence::WAIT, (uint8_t)(cylinder)
+#define SEQ_TOP(message) Sequence::TOP, (uint8_t)(message)
+#define SEQ_BOTTOM(message) Sequence::BOTTOM, (uint8_t)(message)
+#define SEQ_CHECKPOINT Sequence::CHECKPOINT
+#define SEQ_HOME Sequence::HOME
+#define SEQ_BLEND(x) Sequence::BLEND, SEQ_DISTANCE(x)
+
+#endif
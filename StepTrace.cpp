@@ -0,0 +1,107 @@
+// Step-timing instrumentation for the SCARA step ISRs; see StepTrace.h. Everything here compiles away
+// unless STEP_TRACE is defined.
+//
+// Timer5 runs free at the same 0.5 us tick as the step timers and never interrupts. A 16-bit stamp
+// wraps every 32.8 ms, which is just longer than the longest step period (MAX_PERIOD in Axis.h), so
+// the difference of two stamps is always the true period.
+
+#include "StepTrace.h"
+
+#ifdef STEP_TRACE
+
+StepTrace stepTrace;
+
+// Constructor: Provide default values
+StepTrace::StepTrace() {
+    head = 0;
+    tail = 0;
+    dropped = 0;
+}
+
+/*******************************************************************************
+ * PUBLIC FUNCTIONS
+ ******************************************************************************/
+void StepTrace::begin() {
+    // Timer5: normal mode, /8 prescaler (0.5 us ticks), no interrupts. The Arduino core sets it up
+    // for PWM before setup(), so this is done again for every move.
+    TCCR5A = 0;
+    TCCR5B = (1 << CS51);
+    TIMSK5 = 0;
+
+    uint8_t oldSREG = SREG;
+    cli();
+    head = tail;
+    dropped = 0;
+    SREG = oldSREG;
+
+    for (int i = 0; i < AXES; i++) {
+      Stats &s = stats[i];
+      s.steps = 0;
+      s.minCommanded = 0xFFFF; s.maxCommanded = 0;
+      s.minActual = 0xFFFF; s.maxActual = 0;
+      s.worst = 0;
+      s.gaps = 0;
+      for (int b = 0; b < BINS; b++) {s.bins[b] = 0;}
+    }
+}
+
+void StepTrace::record(uint8_t axis, uint16_t commanded) {
+    uint16_t stamp = TCNT5;
+    uint8_t next = (tail + 1) & (BUFFER_SIZE - 1);
+    if (next == head) {dropped++; return;} // Foreground has fallen behind
+    Entry &e = buffer[tail];
+    e.stamp = stamp;
+    e.commanded = commanded;
+    e.axis = axis;
+    tail = next;
+}
+
+void StepTrace::drain() {
+    while (head != tail) {
+      const Entry &e = buffer[head];
+      Stats &s = stats[e.axis];
+      if (e.commanded != 0) { // The first step of a run has nothing to be measured against
+        uint16_t actual = e.stamp - s.lastStamp;
+        int deviation = (int)(actual - e.commanded);
+        s.steps++;
+        s.minCommanded = min(s.minCommanded, e.commanded);
+        s.maxCommanded = max(s.maxCommanded, e.commanded);
+        s.minActual = min(s.minActual, actual);
+        s.maxActual = max(s.maxActual, actual);
+        if (abs(deviation) > abs(s.worst)) {s.worst = deviation;}
+        if (deviation > (int)(GAP_TICKS)) {s.gaps++;}
+
+        // Bin 0 is under 1 us off; each bin after that doubles, the last one takes the rest
+        uint16_t off = abs(deviation) >> 1;
+        int bin = 0;
+        while ((off > 0) && (bin < BINS - 1)) {
+          off >>= 1;
+          bin++;
+        }
+        s.bins[bin]++;
+      }
+      s.lastStamp = e.stamp;
+      head = (head + 1) & (BUFFER_SIZE - 1);
+    }
+}
+
+void StepTrace::report() {
+    drain();
+    for (int i = 0; i < AXES; i++) {
+      Stats &s = stats[i];
+      if (s.steps == 0) {continue;}
+      // Periods are in 0.5 us ticks; print microseconds
+      Serial.print(F("STEP TRACE ")); Serial.print((i == 0) ? F("rot") : F("lin"));
+      Serial.print(F(": ")); Serial.print(s.steps); Serial.print(F(" steps, commanded "));
+      Serial.print(s.minCommanded/2); Serial.print('-'); Serial.print(s.maxCommanded/2);
+      Serial.print(F(" us, actual ")); Serial.print(s.minActual/2); Serial.print('-'); Serial.print(s.maxActual/2);
+      Serial.print(F(" us, worst ")); Serial.print(s.worst/2.0, 1);
+      Serial.print(F(" us, gaps >")); Serial.print(GAP_TICKS/2); Serial.print(F(" us: ")); Serial.println(s.gaps);
+      Serial.print(F("  |deviation| <1/<2/<4/<8/<16/<32/<64/more us:"));
+      for (int b = 0; b < BINS; b++) {Serial.print(' '); Serial.print(s.bins[b]);}
+      Serial.println();
+    }
+    if (dropped) {Serial.print(F("STEP TRACE dropped ")); Serial.println(dropped);}
+}
+
+#endif
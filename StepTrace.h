@@ -0,0 +1,59 @@
+#ifndef STEPTRACE_H
+#define STEPTRACE_H
+
+#include <Arduino.h> //not sure if we need this; we might for the built-in Arduino functions
+
+// Uncomment to time every step pulse and print a jitter report over serial after each SCARA move.
+// Costs about 700 bytes of SRAM and Timer5, so leave it off for competition runs.
+// #define STEP_TRACE
+
+#ifdef STEP_TRACE
+
+// Step-timing instrumentation. The step ISRs stamp each pulse with the count of a free-running timer
+// (Timer5, 0.5 us ticks) and push it into a ring buffer together with the period that step was
+// scheduled with. The foreground drains the buffer while the move runs and keeps, per axis, the
+// spread of commanded and actual periods and a histogram of how far each pulse landed from where it
+// was scheduled. Late pulses are ISR latency: another interrupt (the 1 ms tick, serial, the other
+// axis) was running when the compare match fired.
+class StepTrace {
+
+    public:
+        StepTrace(); // Constructor
+        void begin();                               // Start Timer5 and clear the statistics
+        void record(uint8_t axis, uint16_t commanded); // Stamp one step; only call from a step ISR
+        void drain();                               // Fold buffered steps into the statistics
+        void report();                              // Print the statistics for each axis that moved
+
+    private:
+        static const int BUFFER_SIZE = 128;        // Steps buffered between drains (power of 2)
+        static const int AXES = 2;                  // Axis index 0 = rotational, 1 = linear
+        static const int BINS = 8;                  // Histogram bins, see report()
+        static const uint16_t GAP_TICKS = 40;       // Deviation counted as an ISR gap (20 us)
+
+        struct Entry {
+            uint16_t stamp;                         // TCNT5 when the pulse went out
+            uint16_t commanded;                     // Scheduled period in ticks; 0 = first step of a run
+            uint8_t axis;
+        };
+
+        struct Stats {
+            unsigned long steps;                    // Steps timed
+            uint16_t lastStamp;                     // Stamp of the previous step
+            uint16_t minCommanded, maxCommanded;    // Spread of the scheduled periods (ticks)
+            uint16_t minActual, maxActual;          // Spread of the measured periods (ticks)
+            int worst;                              // Largest deviation, actual - commanded (ticks)
+            unsigned long gaps;                     // Steps more than GAP_TICKS late
+            unsigned long bins[BINS];               // Steps by size of deviation
+        };
+
+        Entry buffer[BUFFER_SIZE];
+        volatile uint8_t head;                      // Next entry to drain; only drain() moves it
+        volatile uint8_t tail;                      // Next free entry; only record() moves it
+        volatile unsigned long dropped;             // Steps lost to a full buffer
+        Stats stats[AXES];
+};
+
+extern StepTrace stepTrace;
+
+#endif
+#endif
@@ -0,0 +1,188 @@
+// Host-side stand-in for the Arduino core, used to build the AGSE firmware on Linux (see Makefile).
+// Only the parts of the core and the ATmega2560 registers the firmware actually uses are provided.
+// Everything here is backed by the virtual-time rig model in Sim.cpp.
+
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+#include <stdio.h>              // The real core has it through Print.h
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "avr/pgmspace.h"
+
+#define AGSE_SIM 1 // Lets firmware code pick a portable path where it talks to hardware directly
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+#define NOT_AN_INTERRUPT -1
+
+// Same macros as the real core (they are macros there too, and long arguments depend on it)
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define abs(x) ((x)>0?(x):-(x))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+/*******************************************************************************
+ * CORE FUNCTIONS
+ ******************************************************************************/
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+/*******************************************************************************
+ * INTERRUPTS
+ ******************************************************************************/
+extern volatile uint8_t SREG;
+void cli(void);
+void sei(void);
+#define noInterrupts() cli()
+#define interrupts() sei()
+#define ISR(vect) extern "C" void vect(void)
+
+/*******************************************************************************
+ * GPIO PORT REGISTERS
+ ******************************************************************************/
+extern volatile uint8_t PORTA, PINA, DDRA, PORTB, PINB, DDRB, PORTC, PINC, DDRC;
+extern volatile uint8_t PORTD, PIND, DDRD, PORTE, PINE, DDRE, PORTF, PINF, DDRF;
+extern volatile uint8_t PORTG, PING, DDRG, PORTH, PINH, DDRH, PORTJ, PINJ, DDRJ;
+extern volatile uint8_t PORTK, PINK, DDRK, PORTL, PINL, DDRL;
+
+// FastPin.h reports every direct register access, so the rig model sees pin edges as they happen
+void simPortWritten(volatile uint8_t *reg);
+void simPortRead(volatile uint8_t *reg);
+#define FASTPIN_WRITTEN(reg) simPortWritten(&(reg))
+#define FASTPIN_READ(reg) simPortRead(&(reg))
+
+/*******************************************************************************
+ * TIMER REGISTERS (ATmega2560 layout)
+ ******************************************************************************/
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1, OCR1A;
+extern volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TIFR2;
+extern volatile uint8_t TCNT2, OCR2A;
+extern volatile uint8_t TCCR3A, TCCR3B, TIMSK3, TIFR3;
+extern volatile uint16_t TCNT3, OCR3A;
+extern volatile uint8_t TCCR4A, TCCR4B, TIMSK4, TIFR4;
+extern volatile uint16_t TCNT4, OCR4A;
+extern volatile uint8_t TCCR5A, TCCR5B, TIMSK5, TIFR5;
+extern volatile uint16_t TCNT5, OCR5A;
+
+// Bit positions are identical on all four 16-bit timers
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define TOIE1 0
+#define OCIE1A 1
+#define TOV1 0
+#define OCF1A 1
+#define CS30 0
+#define CS31 1
+#define CS32 2
+#define WGM32 3
+#define OCIE3A 1
+#define OCF3A 1
+#define CS40 0
+#define CS41 1
+#define CS42 2
+#define WGM42 3
+#define OCIE4A 1
+#define OCF4A 1
+#define CS50 0
+#define CS51 1
+#define CS52 2
+#define WGM52 3
+#define TOIE5 0
+#define OCIE5A 1
+#define TOV5 0
+#define OCF5A 1
+
+// Timer2 (8-bit)
+#define WGM21 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define OCIE2A 1
+#define OCF2A 1
+
+/*******************************************************************************
+ * PRINT AND SERIAL
+ ******************************************************************************/
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        size_t write(const char *str);
+        size_t write(const uint8_t *buffer, size_t size);
+
+        size_t print(const char *str);
+        size_t print(const __FlashStringHelper *str);
+        size_t print(char c);
+        size_t print(int n, int base = DEC);
+        size_t print(unsigned int n, int base = DEC);
+        size_t print(long n, int base = DEC);
+        size_t print(unsigned long n, int base = DEC);
+        size_t print(double n, int digits = 2);
+
+        size_t println(void);
+        size_t println(const char *str);
+        size_t println(const __FlashStringHelper *str);
+        size_t println(char c);
+        size_t println(int n, int base = DEC);
+        size_t println(unsigned int n, int base = DEC);
+        size_t println(long n, int base = DEC);
+        size_t println(unsigned long n, int base = DEC);
+        size_t println(double n, int digits = 2);
+
+    private:
+        size_t printNumber(unsigned long n, int base);
+};
+
+class HardwareSerial : public Print {
+    public:
+        void begin(unsigned long baud);
+        void end();
+        int available(void);
+        int read(void);
+        int peek(void);
+        void flush(void);
+        size_t write(uint8_t c);
+        using Print::write;
+        operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,32 @@
+// Host-side stand-in for the Arduino EEPROM library: 4 KB that start out erased (0xFF). Given a file
+// ("agse_sim -e FILE"), the simulator loads it at start and saves it at the end of the run, so values
+// the firmware learns carry over from one run to the next. Each byte written costs 3.3 ms, as on the AVR.
+
+#ifndef SIM_EEPROM_H
+#define SIM_EEPROM_H
+
+#include "Arduino.h"
+
+class EEPROMClass {
+    public:
+        uint8_t read(int idx);
+        void write(int idx, uint8_t val);
+        void update(int idx, uint8_t val) {if (read(idx) != val) {write(idx, val);}}
+        uint16_t length() {return 4096;}
+
+        template<typename T> T &get(int idx, T &t) {
+            uint8_t *p = (uint8_t *)(&t);
+            for (size_t i = 0; i < sizeof(T); i++) {p[i] = read(idx + i);}
+            return t;
+        }
+
+        template<typename T> const T &put(int idx, const T &t) {
+            const uint8_t *p = (const uint8_t *)(&t);
+            for (size_t i = 0; i < sizeof(T); i++) {update(idx + i, p[i]);}
+            return t;
+        }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,31 @@
+// Host-side stand-in for the LiquidCrystal library. It drives the LCD pins exactly like the real
+// 4-bit library (including its settle delays, which cost virtual time), and the rig model in
+// Sim.cpp decodes the HD44780 protocol from those pins.
+
+#ifndef SIM_LIQUIDCRYSTAL_H
+#define SIM_LIQUIDCRYSTAL_H
+
+#include "Arduino.h"
+
+class LiquidCrystal : public Print {
+    public:
+        LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3);
+        void begin(uint8_t cols, uint8_t rows);
+        void clear();
+        void home();
+        void setCursor(uint8_t col, uint8_t row);
+        void command(uint8_t value);
+        size_t write(uint8_t value);
+        using Print::write;
+
+    private:
+        void send(uint8_t value, uint8_t mode);
+        void write4bits(uint8_t value);
+        void pulseEnable();
+
+        uint8_t rsPin;
+        uint8_t enablePin;
+        uint8_t dataPins[4];
+};
+
+#endif
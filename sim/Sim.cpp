@@ -0,0 +1,1252 @@
+// Virtual-time model of the AGSE rig and the parts of the Arduino core the firmware uses.
+//
+// Time only moves when the firmware calls into the core (delay, millis, digitalRead, yield, ...), or
+// when the main loop comes round. Each time it moves, the model runs forward event by event: timer
+// compare matches fire their ISRs, scripted button presses pull their pins low and fire the attached
+// external interrupts, and the linear cylinders travel between their microswitches. The two stepper
+// axes move one step per rising edge on their pulse pins, and trip their microswitches at the
+// configured limits. The LCD is decoded from its pins, and changes on the top line mark the phases
+// in the run report.
+//
+// With simOpenPty(), the serial port is a pseudo-terminal that a host program can open, and virtual
+// time is held to the wall clock so the host sees the board's real timing.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "Sim.h"
+#include "Arduino.h"
+#include "LiquidCrystal.h"
+#include "EEPROM.h"
+
+/*******************************************************************************
+ * CLOCK AND INTERRUPT STATE
+ ******************************************************************************/
+static uint64_t now = 0;                 // Virtual time in CPU cycles
+static uint64_t endAt = (uint64_t)(-1);  // When the run stops
+static bool inIsr = false;               // True while an ISR runs (time does not move inside ISRs)
+static double wallSeconds() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+static double wallStart = wallSeconds();
+static bool verbose = false;
+static FILE *traceFile = NULL;
+
+volatile uint8_t SREG = 0x80;
+
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, OCR1A;
+volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TIFR2;
+volatile uint8_t TCNT2, OCR2A;
+volatile uint8_t TCCR3A, TCCR3B, TIMSK3, TIFR3;
+volatile uint16_t TCNT3, OCR3A;
+volatile uint8_t TCCR4A, TCCR4B, TIMSK4, TIFR4;
+volatile uint16_t TCNT4, OCR4A;
+volatile uint8_t TCCR5A, TCCR5B, TIMSK5, TIFR5;
+volatile uint16_t TCNT5, OCR5A;
+
+// Interrupt vectors the firmware may define
+extern "C" {
+void TIMER1_COMPA_vect(void) __attribute__((weak));
+void TIMER2_COMPA_vect(void) __attribute__((weak));
+void TIMER3_COMPA_vect(void) __attribute__((weak));
+void TIMER4_COMPA_vect(void) __attribute__((weak));
+void TIMER5_COMPA_vect(void) __attribute__((weak));
+void TIMER5_OVF_vect(void) __attribute__((weak));
+}
+
+static void pollExternalInterrupts();
+
+static void runIsr(void (*isr)(void)) {
+    if (isr == NULL) {return;}
+    inIsr = true;
+    SREG &= ~0x80;
+    isr();
+    SREG |= 0x80;
+    inIsr = false;
+}
+
+/*******************************************************************************
+ * TIMERS
+ ******************************************************************************/
+struct SimTimer {
+    volatile uint8_t *tccrA, *tccrB, *timsk, *tifr;
+    volatile uint16_t *tcnt16, *ocr16;
+    volatile uint8_t *tcnt8, *ocr8;
+    void (*compA)(void);
+    void (*ovf)(void);
+    uint64_t rem;        // Cycles counted towards the next timer tick
+    bool pendingCompA;   // Match happened with interrupts disabled
+    bool pendingOvf;
+};
+
+static SimTimer timers[] = {
+    {&TCCR1A, &TCCR1B, &TIMSK1, &TIFR1, &TCNT1, &OCR1A, NULL, NULL, TIMER1_COMPA_vect, NULL, 0, false, false},
+    {&TCCR2A, &TCCR2B, &TIMSK2, &TIFR2, NULL, NULL, &TCNT2, &OCR2A, TIMER2_COMPA_vect, NULL, 0, false, false},
+    {&TCCR3A, &TCCR3B, &TIMSK3, &TIFR3, &TCNT3, &OCR3A, NULL, NULL, TIMER3_COMPA_vect, NULL, 0, false, false},
+    {&TCCR4A, &TCCR4B, &TIMSK4, &TIFR4, &TCNT4, &OCR4A, NULL, NULL, TIMER4_COMPA_vect, NULL, 0, false, false},
+    {&TCCR5A, &TCCR5B, &TIMSK5, &TIFR5, &TCNT5, &OCR5A, NULL, NULL, TIMER5_COMPA_vect, TIMER5_OVF_vect, 0, false, false},
+};
+static const int NUM_TIMERS = sizeof(timers)/sizeof(timers[0]);
+
+static uint64_t prescale(const SimTimer &t) {
+    static const uint64_t table16[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    static const uint64_t table8[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+    return (t.tcnt8 ? table8 : table16)[*t.tccrB & 7];
+}
+
+static bool ctc(const SimTimer &t) {
+    return t.tcnt8 ? (*t.tccrA & (1 << WGM21)) : (*t.tccrB & (1 << WGM12));
+}
+
+static uint32_t maxCount(const SimTimer &t) {return t.tcnt8 ? 0xFF : 0xFFFF;}
+static uint32_t count(const SimTimer &t) {return t.tcnt8 ? *t.tcnt8 : *t.tcnt16;}
+static uint32_t compare(const SimTimer &t) {return t.tcnt8 ? *t.ocr8 : *t.ocr16;}
+static void setCount(SimTimer &t, uint32_t c) {
+    if (t.tcnt8) {*t.tcnt8 = (uint8_t)c;} else {*t.tcnt16 = (uint16_t)c;}
+}
+
+// Ticks until the counter next wraps to zero (CTC match, or overflow in normal mode)
+static uint64_t ticksToWrap(const SimTimer &t) {
+    uint32_t c = count(t);
+    uint32_t top = ctc(t) ? compare(t) : maxCount(t);
+    if (c > top) {return (uint64_t)(maxCount(t)) + 1 - c + top + 1;} // Runs past the top and wraps
+    return (uint64_t)(top) + 1 - c;
+}
+
+// Cycles until this timer raises an interrupt, or 0 if it never will
+static uint64_t cyclesToEvent(const SimTimer &t) {
+    uint64_t p = prescale(t);
+    if (p == 0) {return 0;}
+    bool wantsCompA = (*t.timsk & (1 << OCIE1A)) && t.compA;
+    bool wantsOvf = (*t.timsk & (1 << TOIE1)) && t.ovf && !ctc(t);
+    if (!wantsCompA && !wantsOvf) {return 0;}
+
+    uint64_t ticks;
+    if (wantsCompA && ctc(t)) {
+      ticks = ticksToWrap(t);
+    }
+    else {
+      uint32_t c = count(t);
+      uint32_t o = compare(t);
+      ticks = ticksToWrap(t);
+      if (wantsCompA) { // Normal mode compare match
+        uint64_t toMatch = (o >= c) ? (uint64_t)(o - c) + 1 : (uint64_t)(maxCount(t)) + 1 - c + o + 1;
+        if (!wantsOvf || (toMatch < ticks)) {ticks = toMatch;}
+      }
+    }
+    return ticks*p - t.rem;
+}
+
+static void advanceTimer(SimTimer &t, uint64_t cycles) {
+    uint64_t p = prescale(t);
+    if (p == 0) {return;}
+    uint64_t total = t.rem + cycles;
+    uint64_t ticks = total/p;
+    t.rem = total % p;
+    if (ticks == 0) {return;}
+
+    uint32_t c = count(t);
+    uint32_t top = ctc(t) ? compare(t) : maxCount(t);
+    if ((c <= top) && (ticks <= (uint64_t)(top) - c)) {
+      setCount(t, c + (uint32_t)(ticks));
+      return;
+    }
+    // Wrapped; work out which interrupts that raised and where the counter ended up
+    uint64_t toWrap = ticksToWrap(t);
+    uint64_t after = (ticks - toWrap) % ((uint64_t)(top) + 1);
+    setCount(t, (uint32_t)(after));
+    if (ctc(t)) {t.pendingCompA = true;}
+    else {t.pendingOvf = true;}
+}
+
+static void advanceTimerCompare(SimTimer &t, uint64_t cycles) {
+    // Normal mode compare matches are not wraps, so check them separately
+    if (ctc(t) || !(*t.timsk & (1 << OCIE1A)) || !t.compA || (prescale(t) == 0)) {
+      advanceTimer(t, cycles);
+      return;
+    }
+    uint32_t before = count(t);
+    uint32_t o = compare(t);
+    uint64_t toMatch = (o >= before) ? (uint64_t)(o - before) + 1 : (uint64_t)(maxCount(t)) + 1 - before + o + 1;
+    uint64_t ticks = (t.rem + cycles)/prescale(t);
+    advanceTimer(t, cycles);
+    if (ticks >= toMatch) {t.pendingCompA = true;}
+}
+
+static void firePendingTimers() {
+    if (!(SREG & 0x80) || inIsr) {return;}
+    for (int i = 0; i < NUM_TIMERS; i++) {
+      SimTimer &t = timers[i];
+      if (t.pendingCompA) {
+        t.pendingCompA = false;
+        if ((*t.timsk & (1 << OCIE1A)) && t.compA) {runIsr(t.compA);}
+      }
+      if (t.pendingOvf) {
+        t.pendingOvf = false;
+        if ((*t.timsk & (1 << TOIE1)) && t.ovf) {runIsr(t.ovf);}
+      }
+    }
+}
+
+/*******************************************************************************
+ * RIG MODEL
+ ******************************************************************************/
+static const int NUM_PINS = 70;
+
+struct PinState {
+    uint8_t mode;
+    uint8_t out;
+};
+static PinState pins[NUM_PINS];
+
+// GPIO ports, kept in step with "pins" for code that uses the registers directly (FastPin.h)
+volatile uint8_t PORTA, PINA, DDRA, PORTB, PINB, DDRB, PORTC, PINC, DDRC;
+volatile uint8_t PORTD, PIND, DDRD, PORTE, PINE, DDRE, PORTF, PINF, DDRF;
+volatile uint8_t PORTG, PING, DDRG, PORTH, PINH, DDRH, PORTJ, PINJ, DDRJ;
+volatile uint8_t PORTK, PINK, DDRK, PORTL, PINL, DDRL;
+
+static const int NUM_PORTS = 11; // A-H, J-L
+static volatile uint8_t *const portOut[NUM_PORTS] = {&PORTA, &PORTB, &PORTC, &PORTD, &PORTE, &PORTF,
+    &PORTG, &PORTH, &PORTJ, &PORTK, &PORTL};
+static volatile uint8_t *const portIn[NUM_PORTS] = {&PINA, &PINB, &PINC, &PIND, &PINE, &PINF,
+    &PING, &PINH, &PINJ, &PINK, &PINL};
+static volatile uint8_t *const portDdr[NUM_PORTS] = {&DDRA, &DDRB, &DDRC, &DDRD, &DDRE, &DDRF,
+    &DDRG, &DDRH, &DDRJ, &DDRK, &DDRL};
+
+// Arduino Mega pin -> port index and bit
+static const int8_t PIN_PORT[54] = {
+    4, 4, 4, 4, 6, 4, 7, 7, 7, 7, 1, 1, 1, 1, 8, 8, 7, 7, 3, 3, 3, 3, 0, 0, 0, 0, 0, 0, 0, 0,
+    2, 2, 2, 2, 2, 2, 2, 2, 3, 6, 6, 6, 10, 10, 10, 10, 10, 10, 10, 10, 1, 1, 1, 1};
+static const uint8_t PIN_BIT[54] = {
+    0, 1, 4, 5, 5, 3, 3, 4, 5, 6, 4, 5, 6, 7, 1, 0, 1, 0, 3, 2, 1, 0, 0, 1, 2, 3, 4, 5, 6, 7,
+    7, 6, 5, 4, 3, 2, 1, 0, 7, 2, 1, 0, 7, 6, 5, 4, 3, 2, 1, 0, 3, 2, 1, 0};
+static const int NUM_PORT_PINS = 54;
+
+static void syncPort(int pin) {
+    // Mirror one pin's mode and output level into its port registers
+    if (pin >= NUM_PORT_PINS) {return;}
+    uint8_t mask = 1 << PIN_BIT[pin];
+    int port = PIN_PORT[pin];
+    if (pins[pin].out) {*portOut[port] |= mask;}
+    else {*portOut[port] &= ~mask;}
+    if (pins[pin].mode == OUTPUT) {*portDdr[port] |= mask;}
+    else {*portDdr[port] &= ~mask;}
+}
+
+// Stepper axes
+struct SimAxis {
+    const char *name;
+    const char *unit;
+    double stepsPerUnit;
+    int pulsePin, dirPin, enablePin;
+    int minPin, maxPin;       // Microswitches closed at or beyond the limits
+    long minLimit, maxLimit;  // Steps
+    long pos;                 // Steps
+    long steps;               // Steps taken
+    long lostSteps;           // Pulses sent while the driver was unpowered
+    uint64_t lastStep;        // Time of the last step
+    uint64_t minGap;          // Shortest time between two steps
+};
+
+static const int RELAY_PWR_PIN = 28; // LOW powers the stepper drivers
+
+static SimAxis axes[] = {
+    {"rot", "deg", 71, 8, 7, 6, 31, 30, -210*71, 0, 0, 0, 0, 0, (uint64_t)(-1)},
+    {"lin", "cm", 5328, 12, 11, 10, 32, 33, 0, 26*5328, 0, 0, 0, 0, (uint64_t)(-1)},
+};
+static const int NUM_AXES = 2;
+
+// Pneumatic/electric cylinders: relays drive them, microswitches sense the ends of travel
+struct SimCylinder {
+    const char *name;
+    int plsPin, minPin;       // Relay pins, active LOW (PLS extends, MIN retracts)
+    int extPin, retPin;       // Microswitches at full extension / full retraction (-1 = none)
+    double travel;            // Seconds for full stroke
+    double pos;               // 0 = retracted, 1 = extended
+    int drive;                // +1 extending, -1 retracting, 0 stopped
+    uint64_t since;           // Time "pos" was last brought up to date
+};
+
+static SimCylinder cylinders[] = {
+    {"door", 22, 23, -1, 36, 5.0, 0.0, 0, 0},
+    {"ign", 27, 26, 4, 3, 4.0, 0.0, 0, 0},
+    {"erc", 25, 24, 21, 20, 8.0, 1.0, 0, 0},
+};
+static const int NUM_CYLINDERS = 3;
+
+static void updateCylinder(SimCylinder &c) {
+    double dt = (double)(now - c.since)/SIM_CYCLES_PER_SEC;
+    c.pos += c.drive*dt/c.travel;
+    if (c.pos < 0) {c.pos = 0;}
+    if (c.pos > 1) {c.pos = 1;}
+    c.since = now;
+}
+
+static void updateCylinderDrive(SimCylinder &c) {
+    updateCylinder(c);
+    bool pls = (pins[c.plsPin].out == LOW);
+    bool min = (pins[c.minPin].out == LOW);
+    c.drive = (pls && !min) ? 1 : ((min && !pls) ? -1 : 0);
+}
+
+static uint64_t cylinderEvent(const SimCylinder &c) {
+    // Time at which a moving cylinder reaches the end of its travel
+    if ((c.drive > 0) && (c.pos < 1)) {return c.since + (uint64_t)((1 - c.pos)*c.travel*SIM_CYCLES_PER_SEC) + 1;}
+    if ((c.drive < 0) && (c.pos > 0)) {return c.since + (uint64_t)(c.pos*c.travel*SIM_CYCLES_PER_SEC) + 1;}
+    return 0;
+}
+
+// Buttons
+struct SimButton {
+    const char *name;
+    int pin;
+    uint64_t pressAt;         // Last pressed at this time
+    uint64_t releaseAt;       // Held low until this time
+};
+
+static SimButton buttons[] = {
+    {"GO", 18, 0, 0},
+    {"PAUSE", 19, 0, 0},
+    {"HOME", 2, 0, 0},
+};
+static const int NUM_BUTTONS = 3;
+static uint64_t bounceCycles = 0;                                // Contact bounce after each edge
+static const uint64_t BOUNCE_CHATTER = SIM_CYCLES_PER_SEC/4000;  // One bounce every 250 us
+
+static int buttonLevel(const SimButton &b) {
+    // The contacts chatter for a while after each edge before they settle
+    if ((now >= b.releaseAt) && (now < b.releaseAt + bounceCycles)) {
+      return (((now - b.releaseAt)/BOUNCE_CHATTER) % 2) ? LOW : HIGH;
+    }
+    if ((now >= b.pressAt) && (now < b.pressAt + bounceCycles)) {
+      return (((now - b.pressAt)/BOUNCE_CHATTER) % 2) ? HIGH : LOW;
+    }
+    return (now < b.releaseAt) ? LOW : HIGH;
+}
+
+static int inputLevel(int pin) {
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+      if ((buttons[i].pin == pin) && (buttonLevel(buttons[i]) == LOW)) {return LOW;}
+    }
+    for (int i = 0; i < NUM_AXES; i++) {
+      if ((axes[i].maxPin == pin) && (axes[i].pos >= axes[i].maxLimit)) {return LOW;}
+      if ((axes[i].minPin == pin) && (axes[i].pos <= axes[i].minLimit)) {return LOW;}
+    }
+    for (int i = 0; i < NUM_CYLINDERS; i++) {
+      SimCylinder &c = cylinders[i];
+      if ((c.extPin == pin) || (c.retPin == pin)) {
+        updateCylinder(c);
+        if ((c.extPin == pin) && (c.pos >= 1)) {return LOW;}
+        if ((c.retPin == pin) && (c.pos <= 0)) {return LOW;}
+      }
+    }
+    return HIGH; // Switches open; inputs are pulled up
+}
+
+// External interrupts
+struct SimExtInt {
+    int pin;
+    void (*fn)(void);
+    int mode;
+    int level;
+};
+
+static SimExtInt extInts[6] = {
+    {2, NULL, 0, HIGH}, {3, NULL, 0, HIGH}, {21, NULL, 0, HIGH},
+    {20, NULL, 0, HIGH}, {19, NULL, 0, HIGH}, {18, NULL, 0, HIGH},
+};
+
+static void pollExternalInterrupts() {
+    for (int i = 0; i < 6; i++) {
+      SimExtInt &e = extInts[i];
+      int level = inputLevel(e.pin);
+      if (level == e.level) {continue;}
+      e.level = level;
+      if (e.fn == NULL) {continue;}
+      bool fire = (e.mode == CHANGE) || ((e.mode == FALLING) && (level == LOW))
+          || ((e.mode == RISING) && (level == HIGH));
+      if (fire && (SREG & 0x80) && !inIsr) {runIsr(e.fn);}
+    }
+}
+
+/*******************************************************************************
+ * LCD (HD44780 decoded from its pins)
+ ******************************************************************************/
+static const int LCD_RS = 44, LCD_EN = 45, LCD_D4 = 46;
+
+static char lcdRows[2][41];
+static uint8_t lcdAddr = 0;
+static bool lcdFourBit = false;
+static bool lcdHighNibble = true;
+static uint8_t lcdLatch = 0;
+
+struct Phase {
+    std::string name;
+    uint64_t start;
+};
+static std::vector<Phase> phases;
+
+static std::string lcdText(int row) {
+    std::string s(lcdRows[row], 16);
+    size_t end = s.find_last_not_of(' ');
+    return (end == std::string::npos) ? std::string() : s.substr(0, end + 1);
+}
+
+static void scriptLcdChanged();
+
+static void lcdChanged(int row) {
+    if (verbose) {
+      printf("[%12.6f] LCD%d |%.16s|\n", (double)(now)/SIM_CYCLES_PER_SEC, row, lcdRows[row]);
+    }
+    if (row == 0) {
+      // Writes within 20 ms of each other are one message being drawn
+      std::string text = lcdText(0);
+      if (!phases.empty() && (now - phases.back().start < 20*SIM_CYCLES_PER_SEC/1000)) {
+        phases.back().name = text;
+      }
+      else if (phases.empty() || (phases.back().name != text)) {
+        Phase p = {text, now};
+        phases.push_back(p);
+      }
+    }
+    scriptLcdChanged();
+}
+
+static void lcdByte(uint8_t value, bool data) {
+    if (data) {
+      int row = (lcdAddr & 0x40) ? 1 : 0;
+      int col = lcdAddr & 0x3F;
+      if (col < 40) {
+        lcdRows[row][col] = (char)(value);
+        lcdAddr = (lcdAddr & 0x40) | ((col + 1) % 40);
+        if (col < 16) {lcdChanged(row);}
+      }
+      return;
+    }
+    if (value & 0x80) {lcdAddr = value & 0x7F;}         // Set DDRAM address
+    else if (value & 0x20) {                               // Function set
+      if (!lcdFourBit && !(value & 0x10)) {lcdFourBit = true; lcdHighNibble = true;}
+    }
+    else if (value == 0x01) {                              // Clear display
+      memset(lcdRows, ' ', sizeof(lcdRows));
+      lcdRows[0][40] = lcdRows[1][40] = 0;
+      lcdAddr = 0;
+      lcdChanged(0);
+      lcdChanged(1);
+    }
+    else if ((value & 0xFE) == 0x02) {lcdAddr = 0;}       // Return home
+}
+
+static void lcdEnableFalling() {
+    uint8_t nibble = 0;
+    for (int i = 0; i < 4; i++) {
+      if (pins[LCD_D4 + i].out) {nibble |= (1 << i);}
+    }
+    bool data = pins[LCD_RS].out;
+    if (!lcdFourBit) { // 8-bit mode during initialisation; the low data lines are not wired
+      lcdByte(nibble << 4, data);
+      return;
+    }
+    if (lcdHighNibble) {
+      lcdLatch = nibble << 4;
+      lcdHighNibble = false;
+    }
+    else {
+      lcdHighNibble = true;
+      lcdByte(lcdLatch | nibble, data);
+    }
+}
+
+/*******************************************************************************
+ * SCRIPT
+ ******************************************************************************/
+enum ActionKind {ACT_PRESS, ACT_END};
+
+struct Action {
+    ActionKind kind;
+    int button;       // Index into buttons[]
+};
+
+struct TimedAction {
+    uint64_t at;
+    Action action;
+};
+
+struct WhenAction {
+    std::string text;
+    uint64_t after;
+    Action action;
+    bool armed;       // Fires once each time the text appears
+};
+
+static std::vector<TimedAction> timed;
+static std::vector<WhenAction> whens;
+
+static void schedule(uint64_t at, const Action &a) {
+    TimedAction t = {at, a};
+    timed.push_back(t);
+}
+
+static void scriptLcdChanged() {
+    std::string rows = lcdText(0) + "\n" + lcdText(1);
+    for (size_t i = 0; i < whens.size(); i++) {
+      WhenAction &w = whens[i];
+      bool shown = (rows.find(w.text) != std::string::npos);
+      if (shown && w.armed) {
+        w.armed = false;
+        schedule(now + w.after, w.action);
+      }
+      else if (!shown) {
+        w.armed = true;
+      }
+    }
+}
+
+static uint64_t goAt = 0;                // First press of GO; the start of the sequence
+
+static void runAction(const Action &a) {
+    if (a.kind == ACT_END) {
+      simFinish();
+    }
+    SimButton &b = buttons[a.button];
+    if ((goAt == 0) && (strcmp(b.name, "GO") == 0)) {goAt = now;}
+    if (verbose) {printf("[%12.6f] press %s\n", (double)(now)/SIM_CYCLES_PER_SEC, b.name);}
+    b.pressAt = now;
+    b.releaseAt = now + 100*SIM_CYCLES_PER_SEC/1000;
+    TimedAction release = {b.releaseAt, a}; // Wake up to release the button
+    release.action.kind = ACT_PRESS;
+    release.action.button = -1 - a.button;
+    timed.push_back(release);
+    for (uint64_t t = BOUNCE_CHATTER; t < bounceCycles; t += BOUNCE_CHATTER) { // And at every bounce
+      release.at = b.pressAt + t;
+      timed.push_back(release);
+      release.at = b.releaseAt + t;
+      timed.push_back(release);
+    }
+    release.at = b.releaseAt + bounceCycles;
+    if (bounceCycles > 0) {timed.push_back(release);}
+}
+
+static int findButton(const char *name) {
+    for (int i = 0; i < NUM_BUTTONS; i++) {
+      if (strcmp(buttons[i].name, name) == 0) {return i;}
+    }
+    return -1;
+}
+
+static SimAxis *findAxis(const char *name) {
+    for (int i = 0; i < NUM_AXES; i++) {
+      if (strcmp(axes[i].name, name) == 0) {return &axes[i];}
+    }
+    return NULL;
+}
+
+static SimCylinder *findCylinder(const char *name) {
+    for (int i = 0; i < NUM_CYLINDERS; i++) {
+      if (strcmp(cylinders[i].name, name) == 0) {return &cylinders[i];}
+    }
+    return NULL;
+}
+
+static bool parseAction(char *rest, Action &a) {
+    char word[32], arg[32];
+    int n = sscanf(rest, "%31s %31s", word, arg);
+    if ((n >= 1) && (strcmp(word, "end") == 0)) {a.kind = ACT_END; a.button = 0; return true;}
+    if ((n == 2) && (strcmp(word, "press") == 0)) {
+      a.kind = ACT_PRESS;
+      a.button = findButton(arg);
+      return a.button >= 0;
+    }
+    return false;
+}
+
+// Script lines:
+//   end <sec>                                stop the run at a fixed time
+//   at <sec> press <GO|PAUSE|HOME>           press a button at a fixed time
+//   at <sec> end
+//   when "<lcd text>" [after <sec>] press <button> | end
+//   bounce <ms>                              button contacts chatter this long after each edge
+//   limit <rot|lin> <min|max> <deg|cm>       place a microswitch
+//   position <rot|lin> <deg|cm>              starting position of an axis
+//   travel <door|ign|erc> <sec>              full-stroke time of a cylinder
+//   cylinder <door|ign|erc> <0..1>           starting position of a cylinder (1 = extended)
+static bool parseLine(char *line, int lineNo) {
+    char *hash = strchr(line, '#');
+    if (hash && !strchr(line, '"')) {*hash = 0;}
+    char cmd[32];
+    int used = 0;
+    if (sscanf(line, " %31s%n", cmd, &used) != 1) {return true;} // Blank line
+    char *rest = line + used;
+    char name[32], which[32];
+    double value;
+
+    if (strcmp(cmd, "end") == 0 && sscanf(rest, "%lf", &value) == 1) {
+      endAt = (uint64_t)(value*SIM_CYCLES_PER_SEC);
+      return true;
+    }
+    if (strcmp(cmd, "at") == 0 && sscanf(rest, "%lf%n", &value, &used) == 1) {
+      Action a;
+      if (parseAction(rest + used, a)) {schedule((uint64_t)(value*SIM_CYCLES_PER_SEC), a); return true;}
+    }
+    if (strcmp(cmd, "when") == 0) {
+      char *open = strchr(rest, '"');
+      char *close = open ? strchr(open + 1, '"') : NULL;
+      if (close) {
+        WhenAction w;
+        w.text = std::string(open + 1, close - open - 1);
+        w.after = 0;
+        w.armed = true;
+        char *tail = close + 1;
+        if (sscanf(tail, " after %lf%n", &value, &used) == 1) {
+          w.after = (uint64_t)(value*SIM_CYCLES_PER_SEC);
+          tail += used;
+        }
+        if (parseAction(tail, w.action)) {whens.push_back(w); return true;}
+      }
+    }
+    if (strcmp(cmd, "bounce") == 0 && sscanf(rest, "%lf", &value) == 1) {
+      bounceCycles = (uint64_t)(value*SIM_CYCLES_PER_SEC/1000);
+      return true;
+    }
+    if (strcmp(cmd, "limit") == 0 && sscanf(rest, "%31s %31s %lf", name, which, &value) == 3) {
+      SimAxis *ax = findAxis(name);
+      if (ax && strcmp(which, "min") == 0) {ax->minLimit = (long)(value*ax->stepsPerUnit); return true;}
+      if (ax && strcmp(which, "max") == 0) {ax->maxLimit = (long)(value*ax->stepsPerUnit); return true;}
+    }
+    if (strcmp(cmd, "position") == 0 && sscanf(rest, "%31s %lf", name, &value) == 2) {
+      SimAxis *ax = findAxis(name);
+      if (ax) {ax->pos = (long)(value*ax->stepsPerUnit); return true;}
+    }
+    if (strcmp(cmd, "travel") == 0 && sscanf(rest, "%31s %lf", name, &value) == 2) {
+      SimCylinder *c = findCylinder(name);
+      if (c) {c->travel = value; return true;}
+    }
+    if (strcmp(cmd, "cylinder") == 0 && sscanf(rest, "%31s %lf", name, &value) == 2) {
+      SimCylinder *c = findCylinder(name);
+      if (c) {c->pos = value; return true;}
+    }
+    fprintf(stderr, "script line %d not understood: %s\n", lineNo, line);
+    return false;
+}
+
+bool simLoadScript(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {return false;}
+    char line[256];
+    int lineNo = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), f)) {
+      lineNo++;
+      line[strcspn(line, "\r\n")] = 0;
+      ok = parseLine(line, lineNo) && ok;
+    }
+    fclose(f);
+    return ok;
+}
+
+void simDefaultScript() {
+    char l1[] = "when \"WAITING FOR GO\" after 0.5 press GO";
+    char l2[] = "when \"PROCESS COMPLETE\" end";
+    char l3[] = "end 900";
+    parseLine(l1, 1);
+    parseLine(l2, 2);
+    parseLine(l3, 3);
+}
+
+// The firmware can spin on a flag without calling into the core (complete() waits for HOME like this);
+// virtual time cannot move then, so the run is stopped once it makes no progress for a second
+static uint64_t watchdogLast = (uint64_t)(-1);
+
+static void watchdog(int sig) {
+    (void)(sig);
+    if (now != watchdogLast) {watchdogLast = now; return;}
+    printf("\n[%12.6f] firmware is spinning without calling into the core; stopping\n",
+        (double)(now)/SIM_CYCLES_PER_SEC);
+    simFinish();
+}
+
+void simStartWatchdog() {
+    signal(SIGALRM, watchdog);
+    struct itimerval interval = {{1, 0}, {1, 0}};
+    setitimer(ITIMER_REAL, &interval, NULL);
+}
+
+void simSetTrace(FILE *file) {traceFile = file;}
+void simSetVerbose(bool v) {verbose = v;}
+
+/*******************************************************************************
+ * SERIAL PORT
+ ******************************************************************************/
+// Bytes from the host arrive at the line rate, into the 64-byte receive buffer of the real
+// HardwareSerial; anything that arrives while it is full is lost and counted as an overrun.
+static const size_t RX_BUFFER_SIZE = 64;
+static int ptyFd = -1;                   // Master side of the pseudo-terminal, if there is one
+static bool ptyOpened = false;           // The host has opened the port at some point
+static double ptySpeed = 1.0;            // Virtual seconds per wall second
+static struct timespec ptyWallStart;     // Wall clock when virtual time was ptyNowStart
+static uint64_t ptyNowStart = 0;
+static uint64_t ptyServicedAt = 0;      // Virtual time the host side was last looked at
+static uint64_t serialByteCycles = SIM_CYCLES_PER_SEC*10/9600; // One byte on the line
+static std::deque<uint8_t> rxLine;       // Sent by the host, still on the line
+static std::deque<uint8_t> rxBuffer;     // Received, waiting for read()
+static uint64_t rxNextAt = 0;            // When the next byte on the line is in
+static unsigned long serialBytesIn = 0;
+static unsigned long serialBytesOut = 0;
+static unsigned long rxOverruns = 0;
+
+bool simOpenPty(double speed) {
+    ptyFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((ptyFd < 0) || (grantpt(ptyFd) < 0) || (unlockpt(ptyFd) < 0)) {return false;}
+    const char *name = ptsname(ptyFd);
+
+    // Raw mode, so the host sees exactly the bytes the firmware writes. The setting stays with the
+    // terminal after this end is closed again.
+    int slave = open(name, O_RDWR | O_NOCTTY);
+    if (slave < 0) {return false;}
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    close(slave);
+
+    fcntl(ptyFd, F_SETFL, O_NONBLOCK);
+    ptySpeed = (speed > 0) ? speed : 1.0;
+    clock_gettime(CLOCK_MONOTONIC, &ptyWallStart);
+    ptyNowStart = now;
+    printf("serial port on %s (%.0fx real time)\n", name, ptySpeed);
+    return true;
+}
+
+static void servicePty() {
+    // Hold virtual time back to the wall clock
+    struct timespec wall;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    double elapsed = (wall.tv_sec - ptyWallStart.tv_sec) + (wall.tv_nsec - ptyWallStart.tv_nsec)*1e-9;
+    double ahead = (double)(now - ptyNowStart)/SIM_CYCLES_PER_SEC/ptySpeed - elapsed;
+    if (ahead > 0.0005) {
+      struct timespec pause = {(time_t)(ahead), (long)((ahead - (time_t)(ahead))*1e9)};
+      nanosleep(&pause, NULL);
+    }
+
+    // Pick up what the host has sent. Reads fail with EIO while nobody has the port open; once the
+    // host has been and gone, the run is over.
+    uint8_t buf[64];
+    ssize_t n = read(ptyFd, buf, sizeof(buf));
+    if (n > 0) {
+      ptyOpened = true;
+      if (rxLine.empty() && (rxNextAt < now)) {rxNextAt = now;}
+      for (ssize_t i = 0; i < n; i++) {rxLine.push_back(buf[i]);}
+    }
+    else if ((n < 0) && (errno == EAGAIN)) {
+      ptyOpened = true;
+    }
+    else if (ptyOpened) {
+      printf("\n[%12.6f] host closed the serial port\n", (double)(now)/SIM_CYCLES_PER_SEC);
+      simFinish();
+    }
+}
+
+static void clockInSerial() {
+    while (!rxLine.empty() && (now >= rxNextAt + serialByteCycles)) {
+      rxNextAt += serialByteCycles;
+      serialBytesIn++;
+      if (rxBuffer.size() < RX_BUFFER_SIZE) {rxBuffer.push_back(rxLine.front());}
+      else {rxOverruns++;}
+      rxLine.pop_front();
+    }
+}
+
+/*******************************************************************************
+ * EVENT LOOP
+ ******************************************************************************/
+uint64_t simNow() {return now;}
+
+static uint64_t nextRigEvent() {
+    uint64_t next = 0;
+    for (size_t i = 0; i < timed.size(); i++) {
+      if ((next == 0) || (timed[i].at < next)) {next = timed[i].at;}
+    }
+    for (int i = 0; i < NUM_CYLINDERS; i++) {
+      uint64_t t = cylinderEvent(cylinders[i]);
+      if ((t != 0) && ((next == 0) || (t < next))) {next = t;}
+    }
+    return next;
+}
+
+static void runRigEvents() {
+    for (size_t i = 0; i < timed.size();) {
+      if (timed[i].at > now) {i++; continue;}
+      Action a = timed[i].action;
+      timed.erase(timed.begin() + i);
+      if ((a.kind == ACT_PRESS) && (a.button < 0)) {continue;} // Button release: level change only
+      runAction(a);
+    }
+    pollExternalInterrupts();
+}
+
+// Cycles until the next interrupt or rig event, but no more than "limit"
+static uint64_t cyclesToNextEvent(uint64_t limit, bool *hit) {
+    uint64_t step = limit;
+    *hit = false;
+    for (int i = 0; i < NUM_TIMERS; i++) {
+      uint64_t c = cyclesToEvent(timers[i]);
+      if ((c != 0) && (c <= step)) {step = c; *hit = true;}
+    }
+    uint64_t rig = nextRigEvent();
+    if ((rig != 0) && (rig > now) && (rig - now <= step)) {step = rig - now; *hit = true;}
+    return step;
+}
+
+void simRunUntil(uint64_t target) {
+    if (inIsr) {return;} // Time stands still inside an ISR
+    while (now < target) {
+      // Run forward to the next thing that happens; only then is there anything to check
+      bool event;
+      uint64_t step = cyclesToNextEvent(target - now, &event);
+      for (int i = 0; i < NUM_TIMERS; i++) {
+        advanceTimerCompare(timers[i], step);
+      }
+      now += step;
+      if (event) {
+        runRigEvents();
+        firePendingTimers();
+        pollExternalInterrupts();
+      }
+
+      if (now >= endAt) {simFinish();}
+    }
+    if ((ptyFd >= 0) && (now - ptyServicedAt >= 100*SIM_CYCLES_PER_US)) { // Not on every 1 us poll
+      ptyServicedAt = now;
+      servicePty();
+    }
+    if (ptyFd >= 0) {clockInSerial();}
+}
+
+void simIdle() {
+    simRunUntil(now + SIM_CYCLES_PER_US);
+}
+
+void simWait() {
+    // Nothing the caller can see changes before the next event, so skip straight to it
+    bool event;
+    simRunUntil(now + cyclesToNextEvent(SIM_CYCLES_PER_SEC/1000, &event));
+}
+
+/*******************************************************************************
+ * ARDUINO CORE
+ ******************************************************************************/
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin >= NUM_PINS) {return;}
+    pins[pin].mode = mode;
+    if (mode == INPUT_PULLUP) {pins[pin].out = HIGH;}
+    if (mode == INPUT) {pins[pin].out = LOW;}
+    syncPort(pin);
+}
+
+static void setPin(int pin, uint8_t level);
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    if (pin >= NUM_PINS) {return;}
+    setPin(pin, val ? HIGH : LOW);
+    syncPort(pin);
+}
+
+void simPortWritten(volatile uint8_t *reg) {
+    for (int port = 0; port < NUM_PORTS; port++) {
+      if (reg == portIn[port]) { // Writing ones to PINx toggles those outputs
+        *portOut[port] ^= *reg;
+        *reg = 0;
+        reg = portOut[port];
+      }
+      if ((reg != portOut[port]) && (reg != portDdr[port])) {continue;}
+
+      for (int pin = 0; pin < NUM_PORT_PINS; pin++) {
+        if (PIN_PORT[pin] != port) {continue;}
+        uint8_t mask = 1 << PIN_BIT[pin];
+        uint8_t level = (*portOut[port] & mask) ? HIGH : LOW;
+        if (*portDdr[port] & mask) {pins[pin].mode = OUTPUT;}
+        else {pins[pin].mode = level ? INPUT_PULLUP : INPUT;}
+        setPin(pin, level);
+      }
+      return;
+    }
+}
+
+void simPortRead(volatile uint8_t *reg) {
+    for (int port = 0; port < NUM_PORTS; port++) {
+      if (reg != portIn[port]) {continue;}
+      if (!inIsr) {simIdle();} // Polling loops cost time
+
+      uint8_t value = 0;
+      for (int pin = 0; pin < NUM_PORT_PINS; pin++) {
+        if (PIN_PORT[pin] != port) {continue;}
+        int level = (pins[pin].mode == OUTPUT) ? pins[pin].out : inputLevel(pin);
+        if (level) {value |= (1 << PIN_BIT[pin]);}
+      }
+      *reg = value;
+      return;
+    }
+}
+
+static void setPin(int pin, uint8_t level) {
+    // Drive an output and let the rig react to the edge
+    uint8_t old = pins[pin].out;
+    pins[pin].out = level;
+    if (old == level) {return;}
+
+    for (int i = 0; i < NUM_AXES; i++) {
+      SimAxis &ax = axes[i];
+      if ((pin != ax.pulsePin) || (level != HIGH)) {continue;}
+      bool powered = (pins[RELAY_PWR_PIN].out == LOW) && (pins[ax.enablePin].out == LOW);
+      if (!powered) {ax.lostSteps++; continue;}
+      ax.pos += pins[ax.dirPin].out ? 1 : -1;
+      ax.steps++;
+      if ((ax.lastStep != 0) && (now - ax.lastStep < SIM_CYCLES_PER_SEC/2) && (now - ax.lastStep < ax.minGap)) {
+        ax.minGap = now - ax.lastStep;
+      }
+      ax.lastStep = now;
+      if (traceFile) {fprintf(traceFile, "%.2f,%s,%ld\n", (double)(now)/SIM_CYCLES_PER_US, ax.name, ax.pos);}
+    }
+    for (int i = 0; i < NUM_CYLINDERS; i++) {
+      if ((pin == cylinders[i].plsPin) || (pin == cylinders[i].minPin)) {updateCylinderDrive(cylinders[i]);}
+    }
+    if ((pin == LCD_EN) && (level == LOW)) {lcdEnableFalling();}
+}
+
+int digitalRead(uint8_t pin) {
+    if (pin >= NUM_PINS) {return LOW;}
+    if (!inIsr) {simIdle();} // Polling loops cost time
+    if (pins[pin].mode == OUTPUT) {return pins[pin].out;}
+    return inputLevel(pin);
+}
+
+unsigned long millis(void) {
+    if (!inIsr) {simIdle();}
+    return (unsigned long)(now/(SIM_CYCLES_PER_US*1000));
+}
+
+unsigned long micros(void) {
+    if (!inIsr) {simIdle();}
+    return (unsigned long)(now/SIM_CYCLES_PER_US);
+}
+
+// The core's yield() is weak so a sketch can replace it. Here it also moves time on, so the sketch's own
+// yield() is built under another name (see Makefile) and called from this one.
+__attribute__((weak)) void simSketchYield(void) {}
+
+void delay(unsigned long ms) {
+    // Like the core's, it calls yield() while it waits, so the sketch's background work carries on
+    uint64_t end = now + ms*1000*SIM_CYCLES_PER_US;
+    while (now < end) {
+      simSketchYield(); // May sleep, which moves time on too
+      if (now >= end) {break;}
+      bool event;
+      simRunUntil(now + cyclesToNextEvent(end - now, &event));
+    }
+}
+
+void delayMicroseconds(unsigned int us) {
+    simRunUntil(now + us*SIM_CYCLES_PER_US);
+}
+
+void yield(void) {
+    simSketchYield();
+    if (!inIsr) {simWait();}
+}
+
+long random(long howbig) {
+    if (howbig == 0) {return 0;}
+    return rand() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig) {return howsmall;}
+    return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+    srand(seed);
+}
+
+int digitalPinToInterrupt(uint8_t pin) {
+    for (int i = 0; i < 6; i++) {
+      if (extInts[i].pin == pin) {return i;}
+    }
+    return NOT_AN_INTERRUPT;
+}
+
+void attachInterrupt(uint8_t num, void (*fn)(void), int mode) {
+    if (num >= 6) {return;}
+    extInts[num].fn = fn;
+    extInts[num].mode = mode;
+    extInts[num].level = inputLevel(extInts[num].pin);
+}
+
+void detachInterrupt(uint8_t num) {
+    if (num >= 6) {return;}
+    extInts[num].fn = NULL;
+}
+
+void cli(void) {
+    SREG &= ~0x80;
+}
+
+void sei(void) {
+    SREG |= 0x80;
+    firePendingTimers();
+}
+
+/*******************************************************************************
+ * PRINT AND SERIAL
+ ******************************************************************************/
+size_t Print::write(const char *str) {
+    return write((const uint8_t *)str, strlen(str));
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {n += write(*buffer++);}
+    return n;
+}
+
+size_t Print::printNumber(unsigned long n, int base) {
+    char buf[8*sizeof(long) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+    *str = 0;
+    if (base < 2) {base = 10;}
+    do {
+      char c = n % base;
+      n /= base;
+      *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return write(str);
+}
+
+size_t Print::print(const char *str) {return write(str);}
+size_t Print::print(const __FlashStringHelper *str) {return write((const char *)str);}
+size_t Print::print(char c) {return write((uint8_t)c);}
+size_t Print::print(int n, int base) {return print((long)n, base);}
+size_t Print::print(unsigned int n, int base) {return print((unsigned long)n, base);}
+size_t Print::print(long n, int base) {
+    if ((base == 10) && (n < 0)) {return write((uint8_t)'-') + printNumber(-n, 10);}
+    return printNumber(n, base);
+}
+size_t Print::print(unsigned long n, int base) {return printNumber(n, base);}
+size_t Print::print(double n, int digits) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", digits, n);
+    return write(buf);
+}
+
+size_t Print::println(void) {return write("\r\n");}
+size_t Print::println(const char *str) {return print(str) + println();}
+size_t Print::println(const __FlashStringHelper *str) {return print(str) + println();}
+size_t Print::println(char c) {return print(c) + println();}
+size_t Print::println(int n, int base) {return print(n, base) + println();}
+size_t Print::println(unsigned int n, int base) {return print(n, base) + println();}
+size_t Print::println(long n, int base) {return print(n, base) + println();}
+size_t Print::println(unsigned long n, int base) {return print(n, base) + println();}
+size_t Print::println(double n, int digits) {return print(n, digits) + println();}
+
+HardwareSerial Serial;
+static bool serialLineStart = true;
+
+void HardwareSerial::begin(unsigned long baud) {
+    if (baud > 0) {serialByteCycles = SIM_CYCLES_PER_SEC*10/baud;}
+}
+void HardwareSerial::end() {}
+
+int HardwareSerial::available(void) {
+    if (inIsr) {return rxBuffer.size();}
+    simIdle();
+    if (rxBuffer.empty()) {simWait();} // Nothing to read: the caller is idling
+    return rxBuffer.size();
+}
+
+int HardwareSerial::read(void) {
+    if (rxBuffer.empty()) {return -1;}
+    uint8_t c = rxBuffer.front();
+    rxBuffer.pop_front();
+    return c;
+}
+
+int HardwareSerial::peek(void) {return rxBuffer.empty() ? -1 : rxBuffer.front();}
+void HardwareSerial::flush(void) {fflush(stdout);}
+
+size_t HardwareSerial::write(uint8_t c) {
+    if (ptyFd >= 0) {
+      serialBytesOut++;
+      if (::write(ptyFd, &c, 1) < 0) {} // Dropped if the host is not listening, as on the real port
+      if (!verbose) {return 1;}
+    }
+    if (c == '\r') {return 1;}
+    if (serialLineStart) {printf("[%12.6f] serial: ", (double)(now)/SIM_CYCLES_PER_SEC);}
+    putchar(c);
+    serialLineStart = (c == '\n');
+    return 1;
+}
+
+/*******************************************************************************
+ * EEPROM
+ ******************************************************************************/
+static uint8_t eeprom[4096];
+static bool eepromErased = false;
+static const char *eepromFile = NULL;
+EEPROMClass EEPROM;
+
+static void eepromInit() {
+    if (eepromErased) {return;}
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    eepromErased = true;
+}
+
+uint8_t EEPROMClass::read(int idx) {
+    eepromInit();
+    if ((idx < 0) || (idx >= (int)(sizeof(eeprom)))) {return 0xFF;}
+    return eeprom[idx];
+}
+
+void EEPROMClass::write(int idx, uint8_t val) {
+    eepromInit();
+    if ((idx < 0) || (idx >= (int)(sizeof(eeprom)))) {return;}
+    eeprom[idx] = val;
+    simRunUntil(now + 3300*SIM_CYCLES_PER_US); // Erase + write time
+}
+
+bool simLoadEeprom(const char *path) {
+    eepromInit();
+    eepromFile = path;
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {return true;} // Starts out erased; created at the end of the run
+    size_t n = fread(eeprom, 1, sizeof(eeprom), f);
+    fclose(f);
+    return n == sizeof(eeprom);
+}
+
+static void saveEeprom() {
+    if (eepromFile == NULL) {return;}
+    FILE *f = fopen(eepromFile, "wb");
+    if (f == NULL) {perror(eepromFile); return;}
+    fwrite(eeprom, 1, sizeof(eeprom), f);
+    fclose(f);
+}
+
+/*******************************************************************************
+ * LIQUIDCRYSTAL (same pin sequence and delays as the 4-bit Arduino library)
+ ******************************************************************************/
+LiquidCrystal::LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3) {
+    rsPin = rs;
+    enablePin = enable;
+    dataPins[0] = d0; dataPins[1] = d1; dataPins[2] = d2; dataPins[3] = d3;
+}
+
+void LiquidCrystal::begin(uint8_t cols, uint8_t rows) {
+    (void)(cols); (void)(rows);
+    pinMode(rsPin, OUTPUT);
+    pinMode(enablePin, OUTPUT);
+    for (int i = 0; i < 4; i++) {pinMode(dataPins[i], OUTPUT);}
+    delayMicroseconds(50000);
+    digitalWrite(rsPin, LOW);
+    digitalWrite(enablePin, LOW);
+    write4bits(0x03); delayMicroseconds(4500);
+    write4bits(0x03); delayMicroseconds(4500);
+    write4bits(0x03); delayMicroseconds(150);
+    write4bits(0x02);
+    command(0x28);           // 4-bit, 2 lines, 5x8 font
+    command(0x0C);           // Display on, no cursor
+    clear();
+    command(0x06);           // Left to right, no shift
+}
+
+void LiquidCrystal::clear() {command(0x01); delayMicroseconds(2000);}
+void LiquidCrystal::home() {command(0x02); delayMicroseconds(2000);}
+
+void LiquidCrystal::setCursor(uint8_t col, uint8_t row) {
+    command(0x80 | (col + (row ? 0x40 : 0x00)));
+}
+
+void LiquidCrystal::command(uint8_t value) {send(value, LOW);}
+size_t LiquidCrystal::write(uint8_t value) {send(value, HIGH); return 1;}
+
+void LiquidCrystal::send(uint8_t value, uint8_t mode) {
+    digitalWrite(rsPin, mode);
+    write4bits(value >> 4);
+    write4bits(value);
+}
+
+void LiquidCrystal::write4bits(uint8_t value) {
+    for (int i = 0; i < 4; i++) {digitalWrite(dataPins[i], (value >> i) & 0x01);}
+    pulseEnable();
+}
+
+void LiquidCrystal::pulseEnable() {
+    digitalWrite(enablePin, LOW);
+    delayMicroseconds(1);
+    digitalWrite(enablePin, HIGH);
+    delayMicroseconds(1);
+    digitalWrite(enablePin, LOW);
+    delayMicroseconds(100);
+}
+
+/*******************************************************************************
+ * REPORT
+ ******************************************************************************/
+void simFinish() {
+    double total = (double)(now)/SIM_CYCLES_PER_SEC;
+    double wall = wallSeconds() - wallStart;
+    fflush(stdout);
+    printf("\n=== AGSE simulation report ===\n");
+    printf("virtual time  %10.3f s   (wall %.3f s, %.0fx real time)\n", total, wall,
+        (wall > 0) ? total/wall : 0.0);
+
+    for (size_t i = 0; (goAt != 0) && (i < phases.size()); i++) {
+      if (phases[i].name != "PROCESS COMPLETE") {continue;}
+      printf("sequence      %10.3f s   (GO to PROCESS COMPLETE)\n",
+          (double)(phases[i].start - goAt)/SIM_CYCLES_PER_SEC);
+      break;
+    }
+
+    printf("\nphases (top LCD line)\n");
+    for (size_t i = 0; i < phases.size(); i++) {
+      uint64_t end = (i + 1 < phases.size()) ? phases[i + 1].start : now;
+      printf("  %10.3f s  %9.3f s  %s\n", (double)(phases[i].start)/SIM_CYCLES_PER_SEC,
+          (double)(end - phases[i].start)/SIM_CYCLES_PER_SEC, phases[i].name.c_str());
+    }
+
+    printf("\naxes\n");
+    for (int i = 0; i < NUM_AXES; i++) {
+      SimAxis &ax = axes[i];
+      double peak = (ax.minGap == (uint64_t)(-1)) ? 0 : (double)(SIM_CYCLES_PER_SEC)/ax.minGap;
+      printf("  %s: %ld steps, position %.2f %s, peak rate %.0f steps/s", ax.name, ax.steps,
+          ax.pos/ax.stepsPerUnit, ax.unit, peak);
+      if (ax.lostSteps) {printf(", %ld pulses while unpowered", ax.lostSteps);}
+      printf("\n");
+    }
+
+    printf("\ncylinders\n");
+    for (int i = 0; i < NUM_CYLINDERS; i++) {
+      updateCylinder(cylinders[i]);
+      printf("  %s: %.2f extended\n", cylinders[i].name, cylinders[i].pos);
+    }
+
+    if (ptyFd >= 0) {
+      printf("\nserial\n  %lu bytes in, %lu bytes out, %lu lost to receive overruns\n",
+          serialBytesIn, serialBytesOut, rxOverruns);
+    }
+    if (traceFile) {fclose(traceFile);}
+    saveEeprom();
+    fflush(stdout);
+    exit(0);
+}
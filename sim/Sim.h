@@ -0,0 +1,28 @@
+// Control interface for the virtual-time AGSE rig model (Sim.cpp). The firmware never includes this;
+// it only sees the Arduino core stand-in in Arduino.h.
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+const uint64_t SIM_CYCLES_PER_US = 16;          // 16 MHz ATmega2560
+const uint64_t SIM_CYCLES_PER_SEC = 16000000;
+
+uint64_t simNow();                  // Virtual time, in CPU cycles
+void simRunUntil(uint64_t cycles);  // Advance virtual time, firing interrupts and rig events on the way
+void simIdle();                     // Cost of one polling call into the core (1 us)
+void simWait();                     // Skip ahead to the next event (at most 1 ms)
+
+bool simLoadScript(const char *path); // Read a rig/script file; returns false if it cannot be read
+void simDefaultScript();              // Press GO when the sketch is ready, stop when the run completes
+void simSetTrace(FILE *file);         // Write one CSV line per step pulse to "file"
+bool simLoadEeprom(const char *path); // Keep the EEPROM in "path" (loaded now, saved at the end)
+void simSetVerbose(bool verbose);     // Echo LCD changes as they happen
+bool simOpenPty(double speed);        // Put Serial on a pseudo-terminal; run at "speed" times real time
+void simStartWatchdog();              // Stop the run if the firmware spins without advancing time
+
+void simFinish();                   // Print the run report and exit
+
+#endif
@@ -0,0 +1,28 @@
+// Host-side stand-in for <avr/pgmspace.h>: flash and RAM share one address space on the host, so
+// PROGMEM data is ordinary const data and the pgm_read_* accessors are plain loads.
+
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+// As in the Arduino core: a flash string gets its own type so print() can tell it from a RAM string
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_float(addr) (*(const float *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+#endif
@@ -0,0 +1,14 @@
+// Host-side stand-in for <avr/sleep.h>: sleeping skips ahead to the next thing that could wake the CPU.
+
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+
+void simWait();
+
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu() simWait()
+
+#endif
@@ -0,0 +1,89 @@
+// Entry point for the host build of the AGSE firmware: runs the sketch's setup() and loop() against
+// the virtual-time rig model, then prints a report of the run.
+//
+// Usage: agse_sim [-v] [-t trace.csv] [-e eeprom.bin] [-p] [-x speed] [script]
+//   -v          echo LCD changes and button presses as they happen
+//   -t FILE     write every step pulse to FILE as "time_us,axis,position"
+//   -e FILE     keep the EEPROM contents in FILE between runs (otherwise it starts out erased)
+//   -p          put the serial port on a pseudo-terminal (its name is printed) and run in real time,
+//               so a host program such as agse_stream can talk to the board; the run ends when the
+//               host closes the port. No buttons are pressed unless a script says so.
+//   -x SPEED    with -p, run SPEED times faster than real time
+//   script      rig/script file (see parseLine in Sim.cpp); without one, GO is pressed as soon as
+//               the sketch is waiting for it and the run stops when the process completes
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Sim.h"
+
+void setup();
+void loop();
+
+// The firmware's global objects may read the EEPROM in their constructors, which run before main().
+// glibc passes the program arguments to constructors as well, so "-e" is handled here, ahead of them.
+static bool eepromOk = true;
+static const char *eepromPath = NULL;
+
+__attribute__((constructor(101))) static void loadEepromEarly(int argc, char **argv) {
+    for (int i = 1; i + 1 < argc; i++) {
+      if (strcmp(argv[i], "-e") == 0) {
+        eepromPath = argv[i + 1];
+        eepromOk = simLoadEeprom(eepromPath);
+      }
+    }
+}
+
+int main(int argc, char **argv) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    const char *script = NULL;
+    bool pty = false;
+    double speed = 1.0;
+    for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-v") == 0) {
+        simSetVerbose(true);
+      }
+      else if ((strcmp(argv[i], "-t") == 0) && (i + 1 < argc)) {
+        FILE *trace = fopen(argv[++i], "w");
+        if (trace == NULL) {perror(argv[i]); return 1;}
+        simSetTrace(trace);
+      }
+      else if ((strcmp(argv[i], "-e") == 0) && (i + 1 < argc)) {
+        i++; // Already loaded
+        if (!eepromOk) {fprintf(stderr, "%s: bad EEPROM file %s\n", argv[0], eepromPath); return 1;}
+      }
+      else if (strcmp(argv[i], "-p") == 0) {
+        pty = true;
+      }
+      else if ((strcmp(argv[i], "-x") == 0) && (i + 1 < argc)) {
+        speed = atof(argv[++i]);
+      }
+      else if (argv[i][0] == '-') {
+        fprintf(stderr, "usage: %s [-v] [-t trace.csv] [-e eeprom.bin] [-p] [-x speed] [script]\n", argv[0]);
+        return 1;
+      }
+      else {
+        script = argv[i];
+      }
+    }
+
+    if (pty && !simOpenPty(speed)) {
+      perror("pseudo-terminal");
+      return 1;
+    }
+
+    if (script == NULL) {
+      if (!pty) {simDefaultScript();}
+    }
+    else if (!simLoadScript(script)) {
+      fprintf(stderr, "%s: cannot use script %s\n", argv[0], script);
+      return 1;
+    }
+
+    simStartWatchdog();
+    setup();
+    for (;;) {
+      loop();
+      simIdle(); // The sketch's main loop sleeps on its own when it has nothing to do
+    }
+}
@@ -0,0 +1,204 @@
+// Reference host client for streaming SCARA motions to the board (protocol in ../HostLink.h). Works
+// the same against the real board's USB port and against agse_sim -p.
+//
+// Usage: agse_stream [-v] [-d SECONDS] DEVICE [MOVES]
+//   DEVICE      serial port, e.g. /dev/ttyACM0, or the pseudo-terminal agse_sim -p prints
+//   MOVES       one motion per line, "<degrees> <cm> [<blend>]" (both arms move together; a motion of
+//               one arm may let the next start within <blend> degrees or cm of its end; '#' starts a
+//               comment); read from standard input if not given
+//   -v          print every line the board sends
+//   -d SECONDS  wait this long before sending each motion, to see how the board copes with a slow host
+//
+// Each motion is sent as soon as the board has answered the last one. At the end the client prints
+// how fast the motions went out, how long the board held each answer back (it stops reading while
+// its queue is full), and the board's own count of underruns and time spent waiting for motions.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+static int port = -1;
+static bool verbose = false;
+static std::string pending;     // Received, not yet a whole line
+
+static double seconds() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static bool openPort(const char *path) {
+    port = open(path, O_RDWR | O_NOCTTY);
+    if (port < 0) {perror(path); return false;}
+    struct termios tio;
+    if (tcgetattr(port, &tio) == 0) { // Not a terminal (e.g. a FIFO) is fine too
+      cfmakeraw(&tio);
+      cfsetispeed(&tio, B115200);
+      cfsetospeed(&tio, B115200);
+      tio.c_cflag |= CLOCAL | CREAD;
+      tcsetattr(port, TCSANOW, &tio);
+    }
+    return true;
+}
+
+static void send(const char *text) {
+    size_t len = strlen(text);
+    while (len > 0) {
+      ssize_t n = write(port, text, len);
+      if (n < 0) {
+        if (errno == EINTR) {continue;}
+        perror("write");
+        exit(1);
+      }
+      text += n;
+      len -= n;
+    }
+}
+
+// Next line from the board, without its line ending. Returns false on timeout (seconds < 0: none).
+static bool receive(std::string &line, double timeout) {
+    double deadline = seconds() + timeout;
+    while (true) {
+      size_t end = pending.find('\n');
+      if (end != std::string::npos) {
+        line = pending.substr(0, end);
+        pending.erase(0, end + 1);
+        if (!line.empty() && (line[line.size() - 1] == '\r')) {line.erase(line.size() - 1);}
+        if (verbose) {printf("< %s\n", line.c_str());}
+        return true;
+      }
+      int wait = -1;
+      if (timeout >= 0) {
+        double left = deadline - seconds();
+        if (left <= 0) {return false;}
+        wait = (int)(left*1000) + 1;
+      }
+      struct pollfd p = {port, POLLIN, 0};
+      int ready = poll(&p, 1, wait);
+      if (ready < 0) {
+        if (errno == EINTR) {continue;}
+        perror("poll");
+        exit(1);
+      }
+      if (ready == 0) {continue;}
+      char buf[256];
+      ssize_t n = read(port, buf, sizeof(buf));
+      if (n <= 0) {fprintf(stderr, "serial port closed\n"); exit(1);}
+      pending.append(buf, n);
+    }
+}
+
+// Wait for the answer to a command. Session endings are reported and end the program.
+static void answer(double timeout, const char *what) {
+    std::string line;
+    while (true) {
+      if (!receive(line, timeout)) {fprintf(stderr, "no answer to %s\n", what); exit(1);}
+      if (line == "ok") {return;}
+      if (line == "bad") {fprintf(stderr, "board could not read %s\n", what); exit(1);}
+      if (line == "paused") {fprintf(stderr, "paused on the board; the rest of the motions were dropped\n"); exit(2);}
+      if (line.compare(0, 6, "error ") == 0) {fprintf(stderr, "board stopped with %s\n", line.c_str()); exit(3);}
+      // Anything else is debug output
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *device = NULL;
+    const char *movesPath = NULL;
+    double delay = 0;
+    for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-v") == 0) {verbose = true;}
+      else if ((strcmp(argv[i], "-d") == 0) && (i + 1 < argc)) {delay = atof(argv[++i]);}
+      else if (argv[i][0] == '-') {device = NULL; break;}
+      else if (device == NULL) {device = argv[i];}
+      else {movesPath = argv[i];}
+    }
+    if (device == NULL) {
+      fprintf(stderr, "usage: %s [-v] [-d SECONDS] DEVICE [MOVES]\n", argv[0]);
+      return 1;
+    }
+
+    // Motions, in hundredths of a degree and cm
+    FILE *in = movesPath ? fopen(movesPath, "r") : stdin;
+    if (in == NULL) {perror(movesPath); return 1;}
+    struct Move {long rot, lin, blend;};
+    std::vector<Move> moves;
+    char text[256];
+    int lineNo = 0;
+    while (fgets(text, sizeof(text), in)) {
+      lineNo++;
+      char *hash = strchr(text, '#');
+      if (hash) {*hash = 0;}
+      double deg, cm, blend = 0;
+      char extra;
+      int fields = sscanf(text, "%lf %lf %lf %c", &deg, &cm, &blend, &extra);
+      if (fields <= 0) {continue;}
+      if ((fields != 2) && (fields != 3)) {
+        fprintf(stderr, "line %d: expected \"<degrees> <cm> [<blend>]\"\n", lineNo);
+        return 1;
+      }
+      Move move = {lround(deg*100), lround(cm*100), lround(blend*100)};
+      moves.push_back(move);
+    }
+    if (in != stdin) {fclose(in);}
+
+    if (!openPort(device)) {return 1;}
+
+    // The board resets when the port opens and takes a few seconds to start listening
+    send("?\n");
+    answer(30, "the first command");
+
+    double started = seconds();
+    double slowest = 0, total = 0;
+    int held = 0;                   // Answers held back more than 20 ms (queue full)
+    for (size_t i = 0; i < moves.size(); i++) {
+      if (delay > 0) {
+        struct timespec pause = {(time_t)(delay), (long)((delay - (time_t)(delay))*1e9)};
+        nanosleep(&pause, NULL);
+      }
+      char command[48];
+      if (moves[i].blend != 0) {
+        snprintf(command, sizeof(command), "M %ld %ld %ld\n", moves[i].rot, moves[i].lin, moves[i].blend);
+      }
+      else {
+        snprintf(command, sizeof(command), "M %ld %ld\n", moves[i].rot, moves[i].lin);
+      }
+      double sent = seconds();
+      send(command);
+      answer(-1, command); // The queue may be full for as long as a motion takes
+      double latency = seconds() - sent;
+      total += latency;
+      if (latency > slowest) {slowest = latency;}
+      if (latency > 0.020) {held++;}
+    }
+    double sentAll = seconds();
+    send("E\n");
+    answer(-1, "the end of the stream");
+
+    // Wait for the arm to finish
+    std::string line;
+    while (receive(line, -1)) {
+      unsigned long motions, underruns, starved, runMs;
+      if (sscanf(line.c_str(), "end %lu %lu %lu %lu", &motions, &underruns, &starved, &runMs) == 4) {
+        double finished = seconds();
+        printf("host:  %zu motions sent in %.3f s (%.1f/s); answer mean %.1f ms, slowest %.1f ms, "
+            "%d held back by a full queue\n", moves.size(), sentAll - started,
+            (sentAll > started) ? moves.size()/(sentAll - started) : 0.0,
+            moves.empty() ? 0.0 : 1000*total/moves.size(), 1000*slowest, held);
+        printf("board: %lu motions in %.3f s (%.3f s on the host clock); %lu underruns, %.3f s waiting "
+            "for motions\n", motions, runMs/1000.0, finished - started, underruns, starved/1000.0);
+        return 0;
+      }
+      if (line == "paused") {fprintf(stderr, "paused on the board before the end\n"); return 2;}
+      if (line.compare(0, 6, "error ") == 0) {fprintf(stderr, "board stopped with %s\n", line.c_str()); return 3;}
+    }
+    return 1;
+}